@@ -0,0 +1,275 @@
+/**
+ * Scheduler benchmark
+ * drives each Thread::ScheduleType directly with synthetic workloads and
+ * reports the cost of AddTask, Update and KillTask, then the rate tasks can
+ * be submitted from several host threads while a thread keeps ticking
+ *
+ * usage: schedBench [tasks] [seed]
+ */
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <random>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include "thread.h"
+
+using namespace Shell;
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * a task to submit and the tick it arrives on
+ */
+struct Spec
+{
+  ull time;
+  ull memory;
+  ull arrival;
+};
+
+struct Workload
+{
+  std::string name;
+  std::vector<Spec> specs;
+};
+
+static double nanosSince(Clock::time_point start)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+/**
+ * every task present at the start, process times uniform in [1, 100]
+ */
+static Workload uniform(size_t n, std::mt19937_64& rng)
+{
+  Workload w{"uniform", {}};
+  std::uniform_int_distribution<ull> time(1, 100);
+  for(size_t i = 0; i < n; i++)
+    w.specs.push_back(Spec{time(rng), 1, 0});
+  return w;
+}
+
+/**
+ * pareto distributed process times, most tasks are short but a few are
+ * very long
+ */
+static Workload heavyTailed(size_t n, std::mt19937_64& rng)
+{
+  Workload w{"heavy-tailed", {}};
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  for(size_t i = 0; i < n; i++)
+  {
+    double t = 1.0 / std::pow(1.0 - u(rng), 1.0 / 1.2);
+    w.specs.push_back(Spec{std::min<ull>(static_cast<ull>(t), 10000), 1, 0});
+  }
+  return w;
+}
+
+/**
+ * tasks arrive in bursts of up to 500 with quiet gaps between them
+ */
+static Workload bursty(size_t n, std::mt19937_64& rng)
+{
+  Workload w{"bursty", {}};
+  std::uniform_int_distribution<ull> time(1, 50);
+  std::uniform_int_distribution<size_t> burst(1, 500);
+  std::uniform_int_distribution<ull> gap(100, 2000);
+  ull arrival = 0;
+  while(w.specs.size() < n)
+  {
+    size_t size = std::min(burst(rng), n - w.specs.size());
+    for(size_t i = 0; i < size; i++)
+      w.specs.push_back(Spec{time(rng), 1, arrival});
+    arrival += gap(rng);
+  }
+  return w;
+}
+
+/**
+ * many tasks of 1 to 4 time units
+ */
+static Workload manyShort(size_t n, std::mt19937_64& rng)
+{
+  Workload w{"many-short", {}};
+  std::uniform_int_distribution<ull> time(1, 4);
+  for(size_t i = 0; i < n; i++)
+    w.specs.push_back(Spec{time(rng), 1, 0});
+  return w;
+}
+
+/**
+ * a hundredth as many tasks of 1000 to 5000 time units
+ */
+static Workload fewLong(size_t n, std::mt19937_64& rng)
+{
+  Workload w{"few-long", {}};
+  std::uniform_int_distribution<ull> time(1000, 5000);
+  for(size_t i = 0; i < std::max<size_t>(n / 100, 1); i++)
+    w.specs.push_back(Spec{time(rng), 1, 0});
+  return w;
+}
+
+struct Result
+{
+  ull ticks;
+  double addNanos;
+  double tickNanos;
+  double maxTickNanos;
+  double killNanos;
+  double tasksPerSec;
+  double bytesPerTask;
+};
+
+/**
+ * submits the workload in one batch per arrival tick and updates one time unit at
+ * a time until every task is done, then times killing a fresh copy of it
+ */
+static Result run(const Workload& w, Thread::ScheduleType type)
+{
+  Result r = Result();
+  std::vector<Spec> specs = w.specs;
+  std::stable_sort(specs.begin(), specs.end(), [](const Spec& a, const Spec& b) { return a.arrival < b.arrival; });
+  {
+    Thread thread(~0ULL, type);
+    size_t next = 0;
+    size_t completed = 0;
+    double updateNanos = 0;
+    size_t peakBytes = 0;
+    while(completed < specs.size())
+    {
+      if(next < specs.size() && specs[next].arrival <= r.ticks)
+      {
+        auto start = Clock::now();
+        std::vector<Task> batch;
+        for(; next < specs.size() && specs[next].arrival <= r.ticks; next++)
+          batch.push_back(Task("bench", specs[next].time, specs[next].memory));
+        thread.AddTasks(batch);
+        r.addNanos += nanosSince(start);
+        peakBytes = std::max(peakBytes, thread.TableFootprint());
+      }
+      auto start = Clock::now();
+      completed += thread.Update(1).size();
+      double tick = nanosSince(start);
+      updateNanos += tick;
+      r.maxTickNanos = std::max(r.maxTickNanos, tick);
+      r.ticks++;
+    }
+    r.addNanos /= specs.size();
+    r.tickNanos = updateNanos / r.ticks;
+    r.tasksPerSec = specs.size() / (updateNanos / 1e9);
+    r.bytesPerTask = static_cast<double>(peakBytes) / specs.size();
+  }
+  {
+    Thread thread(~0ULL, type);
+    std::vector<ull> ids;
+    for(const Spec& s : specs)
+    {
+      Task task("bench", s.time, s.memory);
+      ids.push_back(task.ID());
+      thread.AddTask(task);
+    }
+    std::shuffle(ids.begin(), ids.end(), std::mt19937_64(ids.size()));
+    auto start = Clock::now();
+    for(ull id : ids)
+      thread.KillTask(id);
+    r.killNanos = nanosSince(start) / ids.size();
+  }
+  return r;
+}
+
+struct SubmitResult
+{
+  double tasksPerSec;
+  double maxTickNanos;
+};
+
+/**
+ * producers submit n tasks between them one at a time while this thread
+ * keeps updating, either with AddTask or through the lock free Submit
+ */
+static SubmitResult submitRun(size_t n, unsigned int producers, bool lockFree)
+{
+  SubmitResult r = SubmitResult();
+  Thread thread(~0ULL, Thread::fifo);
+  std::atomic<bool> go(false);
+  std::atomic<unsigned int> finished(0);
+  std::vector<std::thread> pool;
+  for(unsigned int p = 0; p < producers; p++)
+  {
+    pool.emplace_back([&, p]()
+    {
+      while(!go.load())
+        std::this_thread::yield();
+      size_t count = n / producers + (p < n % producers ? 1 : 0);
+      for(size_t i = 0; i < count; i++)
+      {
+        Task task("bench", 1000, 1);
+        if(lockFree)
+          thread.Submit(task);
+        else
+          thread.AddTask(task);
+      }
+      finished++;
+    });
+  }
+  auto start = Clock::now();
+  go = true;
+  while(finished.load() < producers)
+  {
+    auto tick = Clock::now();
+    thread.Update(1);
+    r.maxTickNanos = std::max(r.maxTickNanos, nanosSince(tick));
+  }
+  r.tasksPerSec = n / (nanosSince(start) / 1e9);
+  for(std::thread& t : pool)
+    t.join();
+  return r;
+}
+
+int main(int argc, char** argv)
+{
+  size_t n = argc > 1 ? std::stoull(argv[1]) : 20000;
+  ull seed = argc > 2 ? std::stoull(argv[2]) : 1;
+  std::mt19937_64 rng(seed);
+  std::vector<Workload> workloads;
+  workloads.push_back(uniform(n, rng));
+  workloads.push_back(heavyTailed(n, rng));
+  workloads.push_back(bursty(n, rng));
+  workloads.push_back(manyShort(n, rng));
+  workloads.push_back(fewLong(n, rng));
+
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << std::left << std::setw(14) << "workload" << std::setw(Thread::TypeNameWidth() + 2) << "type"
+            << std::right << std::setw(8) << "tasks" << std::setw(10) << "ticks"
+            << std::setw(10) << "add ns" << std::setw(10) << "tick ns" << std::setw(12) << "max tick ns"
+            << std::setw(10) << "kill ns" << std::setw(14) << "tasks/s" << std::setw(12) << "bytes/task" << std::endl;
+  for(const Workload& w : workloads)
+  {
+    for(size_t t = 0; t < Thread::TypeName.size(); t++)
+    {
+      Result r = run(w, static_cast<Thread::ScheduleType>(t));
+      std::cout << std::left << std::setw(14) << w.name << std::setw(Thread::TypeNameWidth() + 2) << Thread::TypeName[t]
+                << std::right << std::setw(8) << w.specs.size() << std::setw(10) << r.ticks
+                << std::setw(10) << r.addNanos << std::setw(10) << r.tickNanos << std::setw(12) << r.maxTickNanos
+                << std::setw(10) << r.killNanos << std::setw(14) << r.tasksPerSec << std::setw(12) << r.bytesPerTask << std::endl;
+    }
+  }
+
+  std::cout << std::endl << std::left << std::setw(14) << "submit" << std::right << std::setw(10) << "producers"
+            << std::setw(14) << "tasks/s" << std::setw(12) << "max tick ns" << std::endl;
+  for(unsigned int producers : {1u, 2u, 4u})
+  {
+    for(bool lockFree : {false, true})
+    {
+      SubmitResult r = submitRun(n * 10, producers, lockFree);
+      std::cout << std::left << std::setw(14) << (lockFree ? "Submit" : "AddTask") << std::right << std::setw(10) << producers
+                << std::setw(14) << r.tasksPerSec << std::setw(12) << r.maxTickNanos << std::endl;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,128 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+#include <atomic>
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+namespace Shell
+{
+  /**
+   * @brief Bounded lock-free multi-producer multi-consumer queue
+   *
+   * Ring of cells each stamped with a sequence number (Vyukov's design).
+   * A producer claims the cell at the enqueue position by moving the
+   * position forward, writes the item and bumps the cell's sequence to
+   * publish it, a consumer does the same from the dequeue position. No
+   * call ever waits, a full or empty queue makes TryPush or TryPop fail
+   * and leaves what to do to the caller. Producers may also pop, e.g. to
+   * drop the oldest item to make room.
+   */
+  template<typename T>
+  class BoundedQueue
+  {
+    private:
+      struct Cell
+      {
+        std::atomic<size_t> sequence;
+        T value;
+      };
+      /** keeps the positions off the cache lines of the cells and each other */
+      static const size_t PAD = 64;
+
+      std::vector<Cell> cells;
+      size_t mask;
+      char pad0[PAD];
+      std::atomic<size_t> enqueuePos;
+      char pad1[PAD];
+      std::atomic<size_t> dequeuePos;
+      char pad2[PAD];
+
+      static size_t roundUp(size_t capacity)
+      {
+        size_t size = 2;
+        while(size < capacity)
+          size <<= 1;
+        return size;
+      }
+
+    public:
+      /**
+       * @param  capacity  rounded up to a power of two
+       */
+      explicit BoundedQueue(size_t capacity) : cells(roundUp(capacity)), mask(cells.size() - 1)
+      {
+        for(size_t i = 0; i < cells.size(); i++)
+          cells[i].sequence.store(i, std::memory_order_relaxed);
+        enqueuePos.store(0, std::memory_order_relaxed);
+        dequeuePos.store(0, std::memory_order_relaxed);
+      }
+      BoundedQueue(const BoundedQueue&) = delete;
+      BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+      /**
+       * Adds an item, safe from any number of threads
+       * @return  false if the queue is full, value is left untouched
+       */
+      bool TryPush(T& value)
+      {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        while(true)
+        {
+          Cell& cell = cells[pos & mask];
+          size_t seq = cell.sequence.load(std::memory_order_acquire);
+          std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+          if(diff == 0)
+          {
+            if(enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+              cell.value = std::move(value);
+              cell.sequence.store(pos + 1, std::memory_order_release);
+              return true;
+            }
+          }
+          else if(diff < 0)
+            return false;
+          else
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+      }
+      /**
+       * Takes the oldest item, safe from any number of threads
+       * @return  false if the queue is empty
+       */
+      bool TryPop(T& value)
+      {
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        while(true)
+        {
+          Cell& cell = cells[pos & mask];
+          size_t seq = cell.sequence.load(std::memory_order_acquire);
+          std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+          if(diff == 0)
+          {
+            if(dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+              value = std::move(cell.value);
+              cell.sequence.store(pos + mask + 1, std::memory_order_release);
+              return true;
+            }
+          }
+          else if(diff < 0)
+            return false;
+          else
+            pos = dequeuePos.load(std::memory_order_relaxed);
+        }
+      }
+      /** returns the number of items, only a snapshot while others push or pop */
+      size_t Size() const
+      {
+        size_t head = dequeuePos.load(std::memory_order_acquire);
+        size_t tail = enqueuePos.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+      }
+      bool Empty() const { return Size() == 0; }
+      size_t Capacity() const { return mask + 1; }
+  };
+}
+#endif
@@ -12,10 +12,21 @@
 #define ull unsigned long long
 #endif
 #include "thread.h"
-#include <queue>
+#include "workerpool.h"
+#include "trace.h"
+#include "injector.h"
+#include "loader.h"
+#include "monitor/channel.h"
+#include "monitor/protocol.h"
+#include "boundedqueue.h"
 #include <stdio.h> 
 #include <fstream>
 #include <unistd.h> 
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <chrono>
+#include <iomanip>
 
 namespace Shell
 {
@@ -29,6 +40,43 @@ namespace Shell
     ull time;
   };
 
+  /**
+   * number of loaded tasks handed to the threads at once
+   */
+  const size_t LOAD_BATCH = 4096;
+  /**
+   * most bad lines of a workload file printed
+   */
+  const ull LOAD_ERRORS_SHOWN = 10;
+  /**
+   * zero length steps in a row fastforward takes without a task
+   * finishing or arriving before it gives up
+   */
+  const ull MAX_STALLED_STEPS = 16;
+  /**
+   * time the client waits after an update arrives so the ones following
+   * it are published in the same batch
+   */
+  const std::chrono::milliseconds PUBLISH_WINDOW(10);
+  /**
+   * bytes of encoded updates the client sends to the monitor at once
+   */
+  const size_t PUBLISH_CHUNK = 64 * 1024;
+  /**
+   * most task updates waiting for the client at once
+   */
+  const size_t UPDATE_QUEUE_CAPACITY = 1 << 16;
+  /**
+   * longest the client sleeps without being woken, in case a wakeup was
+   * missed
+   */
+  const std::chrono::milliseconds CLIENT_POLL(100);
+  /**
+   * longest a batch of updates waits for room in a full queue before
+   * the rest of it is dropped, so a stalled monitor never stops the ticks
+   */
+  const std::chrono::milliseconds UPDATE_WAIT(10);
+
   const std::vector<std::string> CMDS = 
   {
     "ls",
@@ -48,6 +96,11 @@ namespace Shell
     "chgrp",
     "whoami",
     "switchto",
+    "thread",
+    "load",
+    "fastforward",
+    "trace",
+    "monitor",
     "logout",
     "exit"
   };
@@ -80,16 +133,91 @@ namespace Shell
       std::map<ull, Thread*> threads;
       /**
        * used to track the processes that need to be updated/created.
+       * Filled by the ticking threads and loads, emptied by the client.
+       */
+      BoundedQueue<process> processesToUpdate;
+      /**
+       * what queueUpdate does when processesToUpdate is full:
+       * block waits for the client to make room, at most UPDATE_WAIT,
+       * and drops the new update after that. dropOldest throws away the
+       * oldest waiting update to make room. coalesce drops the new update
+       * right away if it is a change, which a later change or kill of the
+       * task supersedes, and waits like block for adds and kills.
+       * Dropping an add or a kill sets resyncNeeded, so the monitor never
+       * keeps a task that is gone or misses one that exists.
+       */
+      enum UpdatePolicy {block, dropOldest, coalesce};
+      std::atomic<int> updatePolicy;
+      /**
+       * set when an add or kill was dropped, the client then rebuilds
+       * what the monitor shows from the threads and sends all of it
+       */
+      std::atomic<bool> resyncNeeded;
+      /**
+       * only pairs with updateReady and roomReady, the queue itself
+       * takes no lock
+       */
+      std::mutex updateLock;
+      /**
+       * signalled when updates are queued or the computer stops
        */
-      std::queue<process> processesToUpdate;
+      std::condition_variable updateReady;
+      /**
+       * signalled by the client after taking updates while producers
+       * wait for room, counted in roomWaiters
+       */
+      std::condition_variable roomReady;
+      std::atomic<int> roomWaiters;
+      /**
+       * set while the client sleeps on updateReady, producers only take
+       * updateLock to wake it then
+       */
+      std::atomic<bool> clientWaiting;
+      /**
+       * updates queued, the ones dropped because the queue was full, the
+       * most updates ever waiting and the records the client published
+       * after merging the updates of the same task in a batch, read by
+       * the console
+       */
+      std::atomic<ull> queuedCount;
+      std::atomic<ull> droppedCount;
+      std::atomic<ull> maxDepth;
+      std::atomic<ull> publishedCount;
+      /** times the client resent every task after a drop */
+      std::atomic<ull> resyncCount;
+      /**
+       * host threads that update the threads in parallel, nullptr when
+       * the threads are updated serially
+       */
+      WorkerPool* workers;
+      /**
+       * if idle threads steal waiting tasks from busy ones after each tick
+       */
+      bool balancing;
+      /**
+       * held while the threads are being updated or the map of threads changes
+       */
+      std::mutex tickLock;
+      /**
+       * simulated time the threads have been updated for
+       */
+      ull simTime;
+      /**
+       * file scheduler events are recorded to, nullptr when not tracing
+       */
+      TraceWriter* tracer;
+      /**
+       * loaded tasks waiting for their arrival time, guarded by tickLock
+       */
+      Injector injector;
 
-      bool running;
+      std::atomic<bool> running;
 
     // Public functions
     public:
 
       // The constructor taking in the computer name
-      Computer(std::string name)
+      Computer(std::string name) : processesToUpdate(UPDATE_QUEUE_CAPACITY)
       {
         // set the name and call the default constructor
         computerName = name;
@@ -104,8 +232,10 @@ namespace Shell
         for(auto userPair : users)
           delete userPair.second;
 
+        stopTrace();
         for(auto threadPair : threads)
           delete threadPair.second;
+        delete workers;
         // Delete the root : let its deconstructor handle deleting
         // the rest of the file system.
         delete rootFile;
@@ -119,9 +249,22 @@ namespace Shell
       }
 
       // Main constructor - does the heavy lifting
-      Computer()
+      Computer() : processesToUpdate(UPDATE_QUEUE_CAPACITY)
       {
         running = true;
+        simTime = 0;
+        updatePolicy = coalesce;
+        clientWaiting = false;
+        roomWaiters = 0;
+        queuedCount = 0;
+        droppedCount = 0;
+        maxDepth = 0;
+        publishedCount = 0;
+        resyncNeeded = false;
+        resyncCount = 0;
+        tracer = nullptr;
+        workers = nullptr;
+        balancing = false;
         // No user to start off with, need to login.
         curUser = nullptr;
         // Create the root of the file system.
@@ -170,22 +313,25 @@ namespace Shell
         running = true;
         std::thread t(&Computer::client, std::ref(*this));
         console();
-        running = false;
+        {
+          std::lock_guard<std::mutex> guard(updateLock);
+          running = false;
+        }
+        updateReady.notify_all();
         t.join();
       }
       
+      /**
+       * Ticks the threads once a second of real time, fastforward runs
+       * the same ticks back to back
+       */
       void threadUpdate()
       {
         while(running)
         {
-          for(auto threadObj : threads)
           {
-            auto l = threadObj.second->Update(1);
-            for(auto item : l)
-              killTask(item);
-            const Task *t = threadObj.second->GetRunningTask();
-            if (t != nullptr)
-              updateTask(t->ID(), t->MemoryUsage(), t->TimeRemaining());
+            std::lock_guard<std::mutex> guard(tickLock);
+            tick(1);
           }
           sleep(1);
         }
@@ -193,73 +339,1027 @@ namespace Shell
       bool Running() const { return running; }
     // Private functions
     private:
+      /**
+       * prints a table of all the threads
+       */
+      void listThreads()
+      {
+        std::cout << " ID |           type         | num tasks | tasks waiting | tasks finished | running | stolen | donated | free mem | used mem | pending |" << std::endl;
+        for(auto threadPair : threads)
+        {
+          std::string type = threadPair.second->TypeString();
+          std::string spaces = "";
+          int count = Thread::TypeNameWidth() - type.size();
+          for(int i = 0; i < count; i++)
+            spaces += " ";
+          std::cout 
+            << " " << threadPair.second->ID() << "    " << type << spaces << "     "
+            << threadPair.second->NumTasks() << "           " << threadPair.second->NumWaitingTasks() 
+            << "               " << threadPair.second->NumFinishedTasks() 
+            << "              " 
+            << (threadPair.second->HasRunningTask() ? "yes" : "no ")
+            << "       " << threadPair.second->NumStolenTasks()
+            << "        " << threadPair.second->NumDonatedTasks()
+            << "        " << threadPair.second->FreeMemory()
+            << "    " << threadPair.second->UsedMemory()
+            << "    " << threadPair.second->NumPendingTasks() << std::endl; 
+        }
+      }
+
+      /**
+       * Advances every thread by the given simulated time and queues
+       * the resulting updates for the monitor. tickLock must be held.
+       */
+      void tick(ull time)
+      {
+        // stop at every arrival inside of this step so tasks are
+        // submitted at exactly their time
+        bool released = false;
+        while(!injector.Empty() && injector.NextTime() <= simTime + time)
+        {
+          ull part = injector.NextTime() > simTime ? injector.NextTime() - simTime : 0;
+          if(part > 0)
+            advance(part);
+          time -= part;
+          releaseArrivals();
+          released = true;
+        }
+        // a zero step with nothing to release still updates the threads
+        // so tasks with no time left finish and used up quanta rotate
+        if(time > 0 || !released)
+          advance(time);
+      }
+
+      /**
+       * Loads threads and tasks from a workload file, see WorkloadParser.
+       * Tasks are handed to their threads in batches of LOAD_BATCH and
+       * ones with an arrival time go to the injector in the same batches,
+       * as they are parsed. Arrival times count from the simTime the load
+       * started at, one that has passed by the time it is parsed is
+       * released at the next tick, like an immediate task parsed then.
+       * tickLock is only taken to add threads and arrivals so the threads
+       * keep ticking while a large file loads.
+       * @param  binary  if the file is in the binary format
+       */
+      void loadWorkload(const std::string& path, bool binary)
+      {
+        MappedFile file(path);
+        if(!file.Error().empty())
+        {
+          std::cout << "load: error opening file (" << file.Error() << ")" << std::endl;
+          return;
+        }
+        if(!binary && BinaryWorkload::Is(file.Data(), file.Size()))
+        {
+          std::cout << "load: " << path << " is a binary workload, use load -b" << std::endl;
+          return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        // thread ids of the file and the ids of the threads they became
+        std::map<ull, ull> IDMapping;
+        std::map<ull, std::vector<Task>> batches;
+        std::vector<Injector::Arrival> arrivals;
+        size_t batched = 0, added = 0, arriving = 0, rejected = 0;
+        ull badLines = 0;
+        ull base;
+        {
+          std::lock_guard<std::mutex> guard(tickLock);
+          base = simTime;
+        }
+        auto flush = [&]()
+        {
+          for(auto& batch : batches)
+          {
+            size_t count = submitTasks(batch.first, batch.second);
+            added += count;
+            rejected += batch.second.size() - count;
+            batch.second.clear();
+          }
+          if(!arrivals.empty())
+          {
+            std::lock_guard<std::mutex> guard(tickLock);
+            for(Injector::Arrival& arrival : arrivals)
+              injector.Schedule(arrival);
+            arrivals.clear();
+          }
+          batched = 0;
+        };
+
+        WorkloadParser parser;
+        parser.OnThread = [&](const WorkloadParser::ThreadRow& row)
+        {
+          if(threads.find(row.id) == threads.end())
+          {
+            Thread* t = new Thread(row.memory, Thread::IntToType(row.type),
+                                   row.quantum == 0 ? Thread::DEFAULT_QUANTUM : row.quantum);
+            IDMapping.emplace(row.id, t->ID());
+            std::lock_guard<std::mutex> guard(tickLock);
+            addThread(t);
+          }
+          else
+            IDMapping.emplace(row.id, row.id);
+        };
+        parser.OnTask = [&](const WorkloadParser::TaskRow& row)
+        {
+          auto threadIDIt = IDMapping.find(row.threadId);
+          ull threadID = threadIDIt == IDMapping.end() ? 0 : threadIDIt->second;
+          std::string name(row.name, row.nameLength);
+          if(row.arrival > 0)
+          {
+            arrivals.push_back(Injector::Arrival{base + row.arrival, threadID, name, row.time, row.memory});
+            arriving++;
+          }
+          else
+            batches[threadID].push_back(Task(name, row.time, row.memory));
+          if(++batched >= LOAD_BATCH)
+            flush();
+        };
+        parser.OnError = [&](ull line, const std::string& error)
+        {
+          if(++badLines <= LOAD_ERRORS_SHOWN)
+            std::cout << "load: " << path << ":" << line << ": " << error << std::endl;
+        };
+        parser.OnProgress = [&](ull records)
+        {
+          std::cout << "load: " << records << " records..." << std::endl;
+        };
+        ull records = binary ? parser.ParseBinary(file) : parser.Parse(file);
+        flush();
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if(badLines > LOAD_ERRORS_SHOWN)
+          std::cout << "load: " << badLines - LOAD_ERRORS_SHOWN << " more bad lines" << std::endl;
+        std::cout << "load: " << records << " records in " << std::fixed << std::setprecision(3) << seconds << "s";
+        if(seconds > 0)
+          std::cout << " (" << std::setprecision(0) << records / seconds << " records/s)";
+        std::cout << std::defaultfloat << ", " << added << " tasks added";
+        if(arriving > 0)
+          std::cout << ", " << arriving << " arriving later";
+        if(rejected > 0)
+          std::cout << ", " << rejected << " too large for their thread";
+        if(badLines > 0)
+          std::cout << ", " << badLines << " bad lines";
+        std::cout << std::endl;
+      }
+
+      /**
+       * Converts a workload between the text and the binary format,
+       * the direction is picked from the format of the input
+       */
+      void convertWorkload(const std::string& in, const std::string& out)
+      {
+        MappedFile file(in);
+        if(!file.Error().empty())
+        {
+          std::cout << "load: error opening file (" << file.Error() << ")" << std::endl;
+          return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        bool binary = BinaryWorkload::Is(file.Data(), file.Size());
+        WorkloadParser parser;
+        ull badLines = 0;
+        parser.OnError = [&](ull line, const std::string& error)
+        {
+          if(++badLines <= LOAD_ERRORS_SHOWN)
+            std::cout << "load: " << in << ":" << line << ": " << error << std::endl;
+        };
+        ull records = 0;
+        bool written = false;
+        if(binary)
+        {
+          // the text format needs the counts up front, so gather the
+          // threads and count the tasks before writing them
+          std::vector<WorkloadParser::ThreadRow> threadRows;
+          ull taskCount = 0;
+          parser.OnThread = [&](const WorkloadParser::ThreadRow& row) { threadRows.push_back(row); };
+          parser.OnTask = [&](const WorkloadParser::TaskRow&) { taskCount++; };
+          parser.ParseBinary(file);
+          std::ofstream text(out, std::ios::trunc);
+          text << threadRows.size() << "\n";
+          for(const WorkloadParser::ThreadRow& row : threadRows)
+          {
+            text << row.id << " " << row.type << " " << row.memory;
+            if(row.quantum != 0)
+              text << " " << row.quantum;
+            text << "\n";
+          }
+          text << taskCount << "\n";
+          parser.OnError = nullptr;
+          parser.OnThread = nullptr;
+          parser.OnTask = [&](const WorkloadParser::TaskRow& row)
+          {
+            text.write(row.name, row.nameLength);
+            text << " " << row.time << " " << row.memory << " " << row.threadId;
+            if(row.arrival != 0)
+              text << " " << row.arrival;
+            text << "\n";
+          };
+          records = parser.ParseBinary(file);
+          text.close();
+          written = !text.fail();
+        }
+        else
+        {
+          WorkloadWriter writer(out);
+          parser.OnThread = [&](const WorkloadParser::ThreadRow& row) { writer.AddThread(row); };
+          parser.OnTask = [&](const WorkloadParser::TaskRow& row) { writer.AddTask(row); };
+          records = parser.Parse(file);
+          written = writer.Finish();
+        }
+        if(!written)
+        {
+          std::cout << "load: cannot write '" << out << "'" << std::endl;
+          return;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if(badLines > LOAD_ERRORS_SHOWN)
+          std::cout << "load: " << badLines - LOAD_ERRORS_SHOWN << " more bad lines" << std::endl;
+        std::cout << "load: converted " << records << " records to " << (binary ? "text" : "binary") << " in "
+                  << std::fixed << std::setprecision(3) << seconds << "s" << std::defaultfloat;
+        if(badLines > 0)
+          std::cout << ", " << badLines << " bad lines skipped";
+        std::cout << std::endl;
+      }
+
+      /**
+       * Submits the tasks whose arrival time has come to their threads
+       */
+      void releaseArrivals()
+      {
+        std::vector<Injector::Arrival> due;
+        injector.Release(simTime, due);
+        std::map<ull, std::vector<Task>> batches;
+        for(const Injector::Arrival& arrival : due)
+          batches[arrival.threadId].push_back(Task(arrival.name, arrival.processTime, arrival.memory));
+        for(auto& batch : batches)
+          submitTasks(batch.first, batch.second);
+      }
+
+      /**
+       * Adds a batch of tasks to a thread with one hold of its lock and
+       * queues the monitor records of the ones added with one hold of
+       * updateLock. Safe without tickLock as long as only the console
+       * changes the map of threads, a tick waits for at most one batch.
+       * @return  number of tasks added, 0 if the thread does not exist
+       */
+      size_t submitTasks(ull threadId, const std::vector<Task>& batch)
+      {
+        auto threadIt = threads.find(threadId);
+        if(threadIt == threads.end() || batch.empty())
+          return 0;
+        std::vector<bool> added;
+        size_t count = threadIt->second->AddTasks(batch, &added);
+        std::vector<process> records;
+        records.reserve(count);
+        for(size_t i = 0; i < batch.size(); i++)
+        {
+          // like newTask, done tasks are not shown
+          if(added[i] && batch[i].TimeRemaining() > 0)
+            records.push_back(newRecord(batch[i].Name(), batch[i].ID(), threadId, batch[i].MemoryUsage(), batch[i].TimeRemaining()));
+        }
+        queueUpdates(records);
+        return count;
+      }
+
+      /**
+       * Updates every thread by time. The threads advance in lockstep,
+       * all of them to the same simTime under tickLock, because arrivals,
+       * balancing and the trace are ordered by that one clock. The pool
+       * only spreads the work of a step over host threads, it does not
+       * let the simulated threads run ahead of each other.
+       */
+      void advance(ull time)
+      {
+        if(workers != nullptr && threads.size() > 1)
+        {
+          // shard the threads across the workers, each collects its own
+          // updates so the queue is only locked once per worker
+          std::vector<Thread*> list;
+          for(auto threadPair : threads)
+            list.push_back(threadPair.second);
+          size_t count = workers->Size();
+          std::vector<std::vector<process>> pending(count);
+          workers->Run([&](size_t worker)
+          {
+            for(size_t i = worker; i < list.size(); i += count)
+              updateThread(list[i], time, pending[worker]);
+          });
+          for(auto& updates : pending)
+            queueUpdates(updates);
+        }
+        else
+        {
+          std::vector<process> pending;
+          for(auto threadPair : threads)
+            updateThread(threadPair.second, time, pending);
+          queueUpdates(pending);
+        }
+        simTime += time;
+        if(balancing)
+          balance();
+        if(tracer != nullptr)
+          drainTrace();
+      }
+
+      /**
+       * Adds a thread to the map, recording it if tracing,
+       * tickLock must be held
+       */
+      void addThread(Thread* thread)
+      {
+        threads.emplace(thread->ID(), thread);
+        if(tracer != nullptr)
+          traceThread(thread);
+      }
+
+      /**
+       * Writes the settings of a thread to the trace and starts
+       * recording its events
+       */
+      void traceThread(Thread* thread)
+      {
+        TraceEvent e;
+        e.type = TraceEvent::thread;
+        e.threadId = thread->ID();
+        e.time = thread->Clock();
+        e.task = thread->Type();
+        e.processTime = thread->Quantum();
+        e.memory = thread->TotalMemory();
+        e.preferFit = thread->PreferFit();
+        e.retainCount = thread->RetainCount();
+        e.retainAge = thread->RetainAge();
+        tracer->Write(e);
+        thread->SetTracing(true);
+      }
+
+      /** returns the tasks finished on all threads */
+      ull completedTasks() const
+      {
+        ull completed = 0;
+        for(auto threadPair : threads)
+          completed += threadPair.second->NumCompletedTasks();
+        return completed;
+      }
+
+      /**
+       * Writes the events recorded by every thread to the trace
+       */
+      void drainTrace()
+      {
+        for(auto threadPair : threads)
+          drainTrace(threadPair.second);
+      }
+
+      /**
+       * Writes the events recorded by one thread to the trace
+       */
+      void drainTrace(Thread* thread)
+      {
+        std::vector<TraceEvent> events;
+        thread->DrainTrace(events);
+        for(const TraceEvent& e : events)
+          tracer->Write(e);
+      }
+
+      /**
+       * Starts recording scheduler events of every thread to a file
+       * @return  false if the file could not be created
+       */
+      bool startTrace(const std::string& path)
+      {
+        std::lock_guard<std::mutex> guard(tickLock);
+        stopTrace();
+        tracer = new TraceWriter(path);
+        if(!tracer->Good())
+        {
+          delete tracer;
+          tracer = nullptr;
+          return false;
+        }
+        for(auto threadPair : threads)
+        {
+          if(threadPair.second->NumTasks() > 0)
+            std::cout << "trace: thread " << threadPair.first << " already has tasks, they will not be replayed\n";
+          traceThread(threadPair.second);
+        }
+        return true;
+      }
+
+      /**
+       * Writes out what is left and closes the trace, tickLock must be
+       * held if the threads are running
+       */
+      void stopTrace()
+      {
+        if(tracer == nullptr)
+          return;
+        drainTrace();
+        for(auto threadPair : threads)
+          threadPair.second->SetTracing(false);
+        tracer->Flush();
+        delete tracer;
+        tracer = nullptr;
+      }
+
+      /**
+       * Re-executes the adds, kills and steals of a trace on fresh threads at full
+       * speed and compares the scheduling they produce with the recorded one
+       * @param  path  trace file
+       * @param  type  schedule type every thread is replayed with, -1 keeps the recorded ones
+       */
+      void replayTrace(const std::string& path, int type)
+      {
+        TraceReader reader(path);
+        std::vector<TraceEvent> events;
+        TraceEvent event;
+        while(reader.Next(event))
+          events.push_back(event);
+        if(!reader.Error().empty())
+        {
+          std::cout << "trace: " << reader.Error() << std::endl;
+          if(events.empty())
+            return;
+        }
+
+        struct Replayed
+        {
+          Thread* thread;
+          /** clock of the recorded thread when tracing started */
+          ull base;
+          /** recorded scheduling decisions, times relative to base */
+          std::vector<TraceEvent> recorded;
+          ull finished;
+          ull turnaround;
+        };
+        std::map<ull, Replayed> replayed;
+        // when each task was added, kept across threads for stolen ones
+        std::map<ull, ull> addTimes;
+        std::vector<TraceEvent> inputs;
+        ull skipped = 0;
+        for(TraceEvent& e : events)
+        {
+          if(e.type == TraceEvent::thread)
+          {
+            if(replayed.count(e.threadId) == 0)
+            {
+              Replayed& r = replayed[e.threadId];
+              r.thread = new Thread(e.memory, Thread::IntToType(type < 0 ? e.task : type), e.processTime);
+              r.thread->SetPreferFit(e.preferFit);
+              r.thread->SetRetention(e.retainCount, e.retainAge);
+              r.thread->SetTracing(true);
+              r.base = e.time;
+              r.finished = 0;
+              r.turnaround = 0;
+            }
+            continue;
+          }
+          auto replayedIt = replayed.find(e.threadId);
+          if(replayedIt == replayed.end())
+          {
+            skipped++;
+            continue;
+          }
+          Replayed& r = replayedIt->second;
+          e.time = e.time > r.base ? e.time - r.base : 0;
+          if(e.type == TraceEvent::add || e.type == TraceEvent::kill ||
+             e.type == TraceEvent::donate || e.type == TraceEvent::accept)
+            inputs.push_back(e);
+          if(e.type == TraceEvent::add)
+            addTimes[e.task] = e.time;
+          else
+            r.recorded.push_back(e);
+          auto addIt = addTimes.find(e.task);
+          if(e.type == TraceEvent::finish && addIt != addTimes.end())
+          {
+            r.finished++;
+            r.turnaround += e.time - addIt->second;
+          }
+        }
+        std::stable_sort(inputs.begin(), inputs.end(),
+          [](const TraceEvent& a, const TraceEvent& b) { return a.time < b.time; });
+
+        // recorded task ids and the ids of their replayed copies
+        std::map<ull, ull> newIDs, oldIDs;
+        // tasks given up by a donate waiting for their accept, with the
+        // clock of the thread they left
+        std::map<ull, std::pair<TaskRecord, ull>> moving;
+        auto start = std::chrono::steady_clock::now();
+        size_t next = 0;
+        ull now = 0;
+        while(true)
+        {
+          for(; next < inputs.size() && inputs[next].time <= now; next++)
+          {
+            const TraceEvent& e = inputs[next];
+            Thread* thread = replayed[e.threadId].thread;
+            if(e.type == TraceEvent::add)
+            {
+              Task task(e.name, e.processTime, e.memory);
+              if(thread->AddTask(task))
+              {
+                newIDs[e.task] = task.ID();
+                oldIDs[task.ID()] = e.task;
+              }
+            }
+            else if(newIDs.count(e.task) == 0)
+              continue;
+            else if(e.type == TraceEvent::kill)
+              thread->KillTask(newIDs[e.task]);
+            else if(e.type == TraceEvent::donate)
+            {
+              // the replayed schedule may already have run it
+              TaskRecord task;
+              if(thread->DonateTask(newIDs[e.task], task))
+                moving[e.task] = std::make_pair(task, thread->Clock());
+            }
+            else
+            {
+              auto movingIt = moving.find(e.task);
+              if(movingIt != moving.end())
+              {
+                thread->AcceptTasks(std::vector<TaskRecord>(1, movingIt->second.first), movingIt->second.second);
+                moving.erase(movingIt);
+              }
+            }
+          }
+          bool busy = false;
+          ull step = std::numeric_limits<ull>::max();
+          for(auto& replayedPair : replayed)
+          {
+            Thread* thread = replayedPair.second.thread;
+            ull nextEvent = thread->NextEvent();
+            if(thread->Busy())
+            {
+              busy = true;
+              step = std::min(step, nextEvent);
+            }
+          }
+          if(next < inputs.size())
+            step = std::min(step, inputs[next].time - now);
+          else if(!busy)
+            break;
+          for(auto& replayedPair : replayed)
+            replayedPair.second.thread->Update(step);
+          now += step;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "trace: replayed " << events.size() << " events on " << replayed.size() << " threads, "
+                  << now << " time units in " << std::fixed << std::setprecision(3) << seconds << "s";
+        if(skipped > 0)
+          std::cout << " (" << skipped << " events of unknown threads skipped)";
+        std::cout << std::endl;
+        std::cout << " ID |           type         | recorded | replayed | completed | mean turnaround | recorded turnaround |" << std::endl;
+        std::vector<std::string> differences;
+        for(auto& replayedPair : replayed)
+        {
+          Replayed& r = replayedPair.second;
+          std::vector<TraceEvent> produced;
+          r.thread->DrainTrace(produced);
+          produced.erase(std::remove_if(produced.begin(), produced.end(),
+            [](const TraceEvent& e) { return e.type == TraceEvent::add; }), produced.end());
+          for(TraceEvent& e : produced)
+            e.task = oldIDs[e.task];
+          size_t same = 0;
+          while(same < produced.size() && same < r.recorded.size() && produced[same].type == r.recorded[same].type &&
+                produced[same].time == r.recorded[same].time && produced[same].task == r.recorded[same].task)
+            same++;
+          if(same < produced.size() || same < r.recorded.size())
+          {
+            std::string difference = "thread " + std::to_string(replayedPair.first) + " differs at event " + std::to_string(same) + ":";
+            if(same < r.recorded.size())
+              difference += " recorded " + TraceEvent::TypeString(r.recorded[same].type) + " of task " +
+                std::to_string(r.recorded[same].task) + " at " + std::to_string(r.recorded[same].time);
+            if(same < produced.size())
+              difference += " replayed " + TraceEvent::TypeString(produced[same].type) + " of task " +
+                std::to_string(produced[same].task) + " at " + std::to_string(produced[same].time);
+            differences.push_back(difference);
+          }
+
+          std::string typeName = r.thread->TypeString();
+          std::string spaces = "";
+          int count = Thread::TypeNameWidth() - typeName.size();
+          for(int i = 0; i < count; i++)
+            spaces += " ";
+          double mean = r.thread->NumCompletedTasks() == 0 ? 0 :
+            static_cast<double>(r.thread->TotalTurnaround()) / r.thread->NumCompletedTasks();
+          std::cout
+            << " " << replayedPair.first << "    " << typeName << spaces << "     "
+            << r.recorded.size() << "         " << produced.size() << "         " << r.thread->NumCompletedTasks()
+            << "           " << std::setprecision(2) << mean << "              "
+            << (r.finished == 0 ? 0 : static_cast<double>(r.turnaround) / r.finished) << std::endl;
+          delete r.thread;
+        }
+        std::cout << std::defaultfloat;
+        if(differences.empty())
+          std::cout << "trace: replay matches the recording" << std::endl;
+        for(const std::string& difference : differences)
+          std::cout << "trace: " << difference << std::endl;
+      }
+
+      /**
+       * Lets every idle thread steal half of the waiting tasks of the
+       * thread with the longest queue. tickLock must be held.
+       */
+      void balance()
+      {
+        // what happened before the steals goes first in the trace and
+        // each donate right before its accept, so a replay can redo them
+        if(tracer != nullptr)
+          drainTrace();
+        std::vector<process> moves;
+        for(auto thiefPair : threads)
+        {
+          Thread* thief = thiefPair.second;
+          if(thief->Busy())
+            continue;
+          Thread* victim = nullptr;
+          for(auto threadPair : threads)
+          {
+            Thread* thread = threadPair.second;
+            if(thread != thief && thread->NumWaitingTasks() > 1 &&
+               (victim == nullptr || thread->NumWaitingTasks() > victim->NumWaitingTasks()))
+              victim = thread;
+          }
+          if(victim == nullptr)
+            continue;
+          std::vector<TaskRecord> stolen = victim->DonateTasks(victim->NumWaitingTasks() / 2, thief->TotalMemory());
+          // the monitor shows tasks by thread, so move them over there too
+          for(const TaskRecord& t : stolen)
+          {
+            moves.push_back(killRecord(t.id));
+            moves.push_back(newRecord(t.name, t.id, thief->ID(), t.memoryUsage, t.timeRemaining));
+          }
+          thief->AcceptTasks(stolen, victim->Clock());
+          if(tracer != nullptr)
+          {
+            drainTrace(victim);
+            drainTrace(thief);
+          }
+        }
+        queueUpdates(moves);
+      }
+
+      /**
+       * Advances one thread and collects the monitor updates it caused
+       */
+      static void updateThread(Thread* thread, ull time, std::vector<process>& updates)
+      {
+        auto l = thread->Update(time);
+        for(auto item : l)
+          updates.push_back(killRecord(item));
+        TaskRecord t;
+        if (thread->GetRunningTask(t))
+          updates.push_back(updateRecord(t.id, t.memoryUsage, t.timeRemaining));
+      }
+
+      /**
+       * Runs every thread until it has no work left, jumping straight from
+       * one completion/preemption event to the next instead of ticking.
+       * Prints turnaround statistics when done.
+       */
+      void fastForward()
+      {
+        std::lock_guard<std::mutex> guard(tickLock);
+        auto start = std::chrono::steady_clock::now();
+        ull startTime = simTime;
+        ull steps = 0;
+        // zero length steps in a row that neither finished nor released
+        // a task, ends the run instead of spinning with tickLock held
+        ull stalled = 0;
+        while(true)
+        {
+          bool busy = false;
+          ull step = std::numeric_limits<ull>::max();
+          for(auto threadPair : threads)
+          {
+            ull next = threadPair.second->NextEvent();
+            if(threadPair.second->Busy())
+            {
+              busy = true;
+              step = std::min(step, next);
+            }
+          }
+          if(!injector.Empty())
+            step = std::min(step, injector.NextTime() - simTime);
+          else if(!busy)
+            break;
+          ull before = completedTasks() + injector.Size();
+          tick(step);
+          steps++;
+          if(step > 0 || completedTasks() + injector.Size() != before)
+            stalled = 0;
+          else if(++stalled > MAX_STALLED_STEPS)
+          {
+            std::cout << "fastforward: no progress at time " << simTime << ", stopping" << std::endl;
+            break;
+          }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "fastforward: simulated " << simTime - startTime << " time units in "
+                  << steps << " steps (" << std::fixed << std::setprecision(3) << seconds << "s)" << std::endl;
+        std::cout << " ID |           type         | completed | mean turnaround | max turnaround | clock |" << std::endl;
+        ull completed = 0, turnaround = 0;
+        for(auto threadPair : threads)
+        {
+          Thread* thread = threadPair.second;
+          std::string type = thread->TypeString();
+          std::string spaces = "";
+          int count = Thread::TypeNameWidth() - type.size();
+          for(int i = 0; i < count; i++)
+            spaces += " ";
+          double mean = thread->NumCompletedTasks() == 0 ? 0 :
+            static_cast<double>(thread->TotalTurnaround()) / thread->NumCompletedTasks();
+          std::cout
+            << " " << thread->ID() << "    " << type << spaces << "     "
+            << thread->NumCompletedTasks() << "           " << std::setprecision(2) << mean
+            << "              " << thread->MaxTurnaround() << "              " << thread->Clock() << std::endl;
+          completed += thread->NumCompletedTasks();
+          turnaround += thread->TotalTurnaround();
+        }
+        std::cout << "total completed: " << completed << " mean turnaround: "
+                  << (completed == 0 ? 0 : static_cast<double>(turnaround) / completed);
+        if(seconds > 0)
+          std::cout << " (" << std::setprecision(0) << completed / seconds << " tasks/s)";
+        std::cout << std::defaultfloat << std::endl;
+      }
+
+      /**
+       * Prints the wait, response and turnaround distributions of a
+       * thread or policy
+       * @param  label  what the numbers belong to
+       * @param  clock  simulated time the tasks completed in, for throughput
+       */
+      static void printMetrics(const std::string& label, const Thread::Metrics& metrics, ull clock)
+      {
+        ull completed = metrics.turnaround.Count();
+        std::cout << label << ": " << completed << " completed, " << std::fixed << std::setprecision(2)
+                  << (clock == 0 ? 0 : 1000.0 * completed / clock) << " per 1000 time units" << std::endl;
+        std::cout << "               mean      p50      p95      p99      max" << std::endl;
+        const std::array<std::pair<std::string, const Histogram*>, 3> rows{{
+          {"wait      ", &metrics.wait}, {"response  ", &metrics.response}, {"turnaround", &metrics.turnaround}}};
+        for(auto row : rows)
+        {
+          std::cout << "  " << row.first << std::setw(9) << row.second->Mean()
+                    << std::setw(9) << row.second->Percentile(50) << std::setw(9) << row.second->Percentile(95)
+                    << std::setw(9) << row.second->Percentile(99) << std::setw(9) << row.second->Max() << std::endl;
+        }
+        std::cout << std::defaultfloat;
+      }
+
+      /**
+       * Prints the metrics of one thread, or of every thread and then of
+       * every policy in use
+       * @param  only  thread to show, nullptr for all
+       */
+      void showStats(Thread* only)
+      {
+        if(only != nullptr)
+        {
+          printMetrics("thread " + std::to_string(only->ID()) + " (" + only->TypeString() + ")",
+                       only->GetMetrics(), only->Clock());
+          return;
+        }
+        std::map<Thread::ScheduleType, std::pair<Thread::Metrics, ull>> policies;
+        for(auto threadPair : threads)
+        {
+          Thread* thread = threadPair.second;
+          Thread::Metrics metrics = thread->GetMetrics();
+          printMetrics("thread " + std::to_string(thread->ID()) + " (" + thread->TypeString() + ")",
+                       metrics, thread->Clock());
+          auto& policy = policies[thread->Type()];
+          policy.first.wait.Merge(metrics.wait);
+          policy.first.response.Merge(metrics.response);
+          policy.first.turnaround.Merge(metrics.turnaround);
+          policy.second += thread->Clock();
+        }
+        // throughput of a policy is per thread, so it is over the summed clocks
+        for(auto policy : policies)
+          printMetrics("policy " + Thread::TypeName[policy.first], policy.second.first, policy.second.second);
+      }
+
     // handles the client side server
-    // @input running: should be a pointer to the running variable of the computer.
-    // @input conected: should be a pointer to the connected variable of the computer.
-    // @input tasks: should be a pointer to the proccesses vector.
-    // @input update: should be a pointer to the update queue.
+    // sleeps until updates are queued, then publishes them to the task
+    // monitor in batches as binary records (see UpdateEncoder) through
+    // the shared memory ring, or writes them to monitor/share.txt if
+    // shared memory is not available. The updates of one task within a
+    // batch are merged into one record and each batch is flushed once.
+    // A monitor attaching to the ring first gets every live task, and
+    // after an add or kill was dropped every task is sent again.
     void client()
     {
-      //std::ofstream writing;
-      std::ofstream outfile ("monitor/share.txt",std::ofstream::app);
-      std::string input;
-      char buffer[256];
+      RingWriter ring;
+      std::ofstream outfile;
+      if (!ring.Open())
+      {
+        outfile.open("monitor/share.txt", std::ofstream::binary | std::ofstream::trunc);
+      }
+      std::string buffer;
+      UpdateEncoder encoder(buffer);
+      auto send = [&](bool flush)
+      {
+        if (ring.IsOpen())
+        {
+          if (!buffer.empty())
+            ring.Write(buffer);
+        }
+        else
+        {
+          outfile.write(buffer.data(), buffer.size());
+          if (flush)
+            outfile.flush();
+        }
+        buffer.clear();
+      };
+
+      // tasks the monitor has been told about, sent again in full to a
+      // monitor that attaches to the ring while the shell runs
+      std::unordered_map<int, process> live;
+      auto snapshot = [&]()
+      {
+        encoder.Hello();
+        encoder.Clear();
+        for (const auto& task : live)
+        {
+          const process& up = task.second;
+          encoder.Add(up.id, up.name, up.threadId, up.memory, up.time);
+          if (buffer.size() >= PUBLISH_CHUNK)
+            send(false);
+        }
+        send(true);
+      };
+
+      // replaces live with the tasks the threads hold now. Waits for no
+      // tick, a busy tickLock leaves it for the next pass.
+      auto rebuild = [&]()
+      {
+        std::unique_lock<std::mutex> guard(tickLock, std::try_to_lock);
+        if (!guard.owns_lock())
+          return false;
+        live.clear();
+        for (auto threadPair : threads)
+        {
+          for (const TaskRecord& t : threadPair.second->LiveTasks())
+          {
+            if (t.timeRemaining > 0)
+              live[t.id] = newRecord(t.name, t.id, threadPair.first, t.memoryUsage, t.timeRemaining);
+          }
+        }
+        return true;
+      };
 
-      input = "c\n";
-      for (unsigned int i = 0; i < input.size(); i++)
-      {
-        buffer[i] = input[i];
-      }
-      outfile.write(buffer, input.size());
+      snapshot();
 
-      while (running) 
+      std::vector<process> batch;
+      std::vector<process> merged;
+      while (true) 
       {
-        //writing.open("share.txt");
-        if (!outfile.is_open())
+        if (!ring.IsOpen() && !outfile.is_open())
         {
           std::cout << "HUSTON WE HAVE A PROBLEM!" << std::endl;
         }
-        if (processesToUpdate.size() > 0)
+        if (processesToUpdate.Empty())
         {
-          process up = processesToUpdate.front();
-          processesToUpdate.pop();
-          if (up.threadId == -1)
+          std::unique_lock<std::mutex> guard(updateLock);
+          clientWaiting = true;
+          std::atomic_thread_fence(std::memory_order_seq_cst);
+          updateReady.wait_for(guard, CLIENT_POLL, [this]() { return !running || !processesToUpdate.Empty(); });
+          clientWaiting = false;
+        }
+        bool resend = ring.IsOpen() && ring.NewReader();
+        if (resyncNeeded.exchange(false))
+        {
+          if (rebuild())
           {
-            input = "u" + std::to_string(up.id) + "-" +
-                    std::to_string(up.memory) + "-" +
-                    std::to_string((up.time > 999999) ? 999999 : up.time) + "|\n";
+            resend = true;
+            resyncCount++;
           }
           else
+            resyncNeeded = true;
+        }
+        if (resend)
+          snapshot();
+        if (processesToUpdate.Empty())
+        {
+          if (!running)
+            break;
+          continue;
+        }
+        // let the rest of a tick's updates arrive before taking them,
+        // cut short once the queue is half full or a producer waits
+        if (running)
+        {
+          std::unique_lock<std::mutex> guard(updateLock);
+          clientWaiting = true;
+          std::atomic_thread_fence(std::memory_order_seq_cst);
+          updateReady.wait_for(guard, PUBLISH_WINDOW, [this]()
+          {
+            return !running || roomWaiters > 0 || processesToUpdate.Size() >= processesToUpdate.Capacity() / 2;
+          });
+          clientWaiting = false;
+        }
+        batch.clear();
+        process up;
+        while (batch.size() < processesToUpdate.Capacity() && processesToUpdate.TryPop(up))
+          batch.push_back(std::move(up));
+        // pairs with the producer counting itself in roomWaiters before
+        // it looks at the queue again
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (roomWaiters > 0)
+        {
+          std::lock_guard<std::mutex> guard(updateLock);
+          roomReady.notify_all();
+        }
+        merged.clear();
+        mergeUpdates(batch, merged);
+        for (const process& up : merged)
+        {
+          // after a resync the adds and kills queued before it are
+          // already in live, skip them instead of sending them twice
+          if (up.threadId != -1)
           {
-            input = "n" + std::to_string(up.id) + "-" + up.name + "-" +
-                    std::to_string(up.threadId) + "-" + std::to_string(up.memory)
-                    + "-" + std::to_string((up.time > 999999) ? 999999 : up.time)
-                    + "|\n";
+            if (!live.emplace(up.id, up).second)
+              continue;
+            encoder.Add(up.id, up.name, up.threadId, up.memory, up.time);
           }
-          for (unsigned int i = 0; i < input.size(); i++)
+          else if (up.time == 0)
           {
-            buffer[i] = input[i];
+            if (live.erase(up.id) == 0)
+              continue;
+            encoder.Kill(up.id);
           }
-
-          outfile.write(buffer, input.size());
-          outfile.flush();
-          //std::cout << buffer << "----" << std::endl;
+          else
+          {
+            encoder.Change(up.id, up.memory, up.time);
+            auto liveIt = live.find(up.id);
+            if (liveIt != live.end())
+            {
+              liveIt->second.memory = up.memory;
+              liveIt->second.time = up.time;
+            }
+          }
+          if (buffer.size() >= PUBLISH_CHUNK)
+            send(false);
         }
-        //writing.close();
-      }
-
-      input = "q\n";
-      for (unsigned int i = 0; i < input.size(); i++)
-      {
-        buffer[i] = input[i];
+        send(true);
+        publishedCount += merged.size();
       }
-      outfile.write(buffer, input.size());
 
-      outfile.close();
+      encoder.Quit();
+      send(true);
 
       return;
     }
 
+    /**
+     * Merges the updates of the same task, moving them from batch into merged in
+     * order. A change folds into the task's earlier add or change, a kill
+     * replaces its earlier change and cancels an add the monitor has not
+     * seen yet.
+     */
+    static void mergeUpdates(std::vector<process>& batch, std::vector<process>& merged)
+    {
+      // index in merged of the last record of each task
+      std::unordered_map<int, size_t> last;
+      std::vector<bool> cancelled;
+      for (process& up : batch)
+      {
+        bool add = up.threadId != -1;
+        auto lastIt = add ? last.end() : last.find(up.id);
+        if (lastIt != last.end() && !cancelled[lastIt->second])
+        {
+          process& prev = merged[lastIt->second];
+          bool prevAdd = prev.threadId != -1;
+          if (prevAdd && up.time == 0)
+          {
+            cancelled[lastIt->second] = true;
+            continue;
+          }
+          if (prevAdd || prev.time != 0)
+          {
+            prev.memory = up.memory;
+            prev.time = up.time;
+            continue;
+          }
+        }
+        last[up.id] = merged.size();
+        merged.push_back(std::move(up));
+        cancelled.push_back(false);
+      }
+      size_t kept = 0;
+      for (size_t i = 0; i < merged.size(); i++)
+      {
+        if (cancelled[i])
+          continue;
+        // moving a string onto itself empties it
+        if (kept != i)
+          merged[kept] = std::move(merged[i]);
+        kept++;
+      }
+      merged.resize(kept);
+    }
+
 
       // Login function. returns true if user and password is valid
       // false otherwise
@@ -1083,112 +2183,266 @@ namespace Shell
           {
             std::cout << "load: missing argument" << std::endl;
           }
+          else if(args[0] == "-b" && args.size() == 2)
+          {
+            loadWorkload(args[1], true);
+          }
+          else if(args[0] == "-c" && args.size() == 3)
+          {
+            convertWorkload(args[1], args[2]);
+          }
           else if(args.size() > 1)
           {
             std::cout << "load: too many arguments" << std::endl;
           }
           else
           {
-            // hold results by string
-            std::string buffer = "";
-            // check if args[0] is a valid file
-            std::ifstream file (args[0]);
-
-            // check if the file is open
-            if(!file.is_open())
+            loadWorkload(args[0], false);
+          }
+          
+        }
+        else if(command == "fastforward" || command == "ff")
+        {
+          if(args.size() > 1)
+          {
+            std::cout << command << ": too many arguments" << std::endl;
+          }
+          else
+          {
+            if(args.size() == 1)
+              commands("load", args);
+            fastForward();
+          }
+        }
+        else if(command == "trace")
+        {
+          if(args.size() < 1)
+          {
+            std::lock_guard<std::mutex> guard(tickLock);
+            if(tracer == nullptr)
+              std::cout << "trace: not recording\n";
+            else
+              std::cout << "trace: recording, " << tracer->Count() << " events written\n";
+          }
+          else if(args[0] == "start" && args.size() == 2)
+          {
+            if(!startTrace(args[1]))
+              std::cout << "trace: cannot write '" << args[1] << "'\n";
+          }
+          else if(args[0] == "stop" && args.size() == 1)
+          {
+            std::lock_guard<std::mutex> guard(tickLock);
+            if(tracer == nullptr)
+              std::cout << "trace: not recording\n";
+            else
             {
-              std::cout << "load: error opening file" << std::endl;
+              std::cout << "trace: " << tracer->Count() << " events written\n";
+              stopTrace();
             }
-            else
+          }
+          else if(args[0] == "replay" && (args.size() == 2 || args.size() == 3))
+          {
+            int type = -1;
+            if(args.size() == 3)
             {
-              int threadCount = 0;
-              file >> threadCount;
-              std::map<ull, ull> IDMapping;
-              // load in the thread config
-              for(int i = 0; i < threadCount; i++)
+              try
               {
-                int type;
-                ull id, mem;
-
-                file >> id >> type >> mem;
-                auto threadIt = threads.find(id);
-                if(threadIt == threads.end())
-                {
-                  Thread* t = new Thread(mem, Thread::IntToType(type));
-                  IDMapping.emplace(id, t->ID());
-                  threads.emplace(t->ID(), t);
-                }
-                else
-                  IDMapping.emplace(id, id);
-                
+                type = std::stoi(args[2]);
               }
-              
-              int taskCount = 0;
-              // add task
-              file >> taskCount;
-              for(int i = 0; i < taskCount; i++)
+              catch(const std::exception&)
               {
-                std::string taskName;
-                ull taskTime, taskMem, threadID;
-                file >> taskName >> taskTime >> taskMem >> threadID;
-                auto threadIDIt = IDMapping.find(threadID);
-                if(threadIDIt == IDMapping.end())
-                  threadID = 0;
-                else
-                  threadID = threadIDIt->second;
-                
-                // add new task
-                auto threadmother = threads.find(threadID);
-                Task* t = new Task(taskName, taskTime, taskMem); 
-                if(!threadmother->second->AddTask(t))
-                  delete t;
-                else
-                  newTask(t->Name(), t->ID(), threadID, t->MemoryUsage(), t->TimeRemaining());
+                type = -1;
               }
-              
+              if(type < Thread::fifo || type > Thread::shortestremaining)
+              {
+                std::cout << "trace: invalid schedule type '" << args[2] << "'\n";
+                return true;
+              }
+            }
+            try
+            {
+              replayTrace(args[1], type);
+            }
+            catch(const std::exception& e)
+            {
+              std::cout << "trace: replay of '" << args[1] << "' failed: " << e.what() << "\n";
             }
           }
-          
+          else
+            std::cout << "Usage: trace [start <file>|stop|replay <file> [type id]]\n";
+        }
+        else if(command == "monitor")
+        {
+          static const std::vector<std::string> POLICIES = {"block", "drop-oldest", "coalesce"};
+          if(args.size() == 2 && args[0] == "policy")
+          {
+            auto policy = std::find(POLICIES.begin(), POLICIES.end(), args[1]);
+            if(policy == POLICIES.end())
+              std::cout << "monitor: invalid policy '" << args[1] << "'\n";
+            else
+              updatePolicy = static_cast<int>(policy - POLICIES.begin());
+          }
+          else if(!args.empty())
+            std::cout << "Usage: monitor [policy block|drop-oldest|coalesce]\n";
+          else
+          {
+            std::cout << "monitor: " << queuedCount << " updates queued, " << droppedCount << " dropped, "
+                      << publishedCount << " records published after merging, " << resyncCount << " resyncs\n";
+            std::cout << "monitor: " << processesToUpdate.Size() << " waiting, at most " << maxDepth
+                      << " of " << processesToUpdate.Capacity() << ", policy " << POLICIES[updatePolicy] << "\n";
+          }
         }
         // Handle help command
         else if(command == "thread")
         {
-          if(args.size() < 1)
+          if(args.size() < 1 || args[0] == "list")
           {
-            std::cout << " ID |           type         | num tasks | tasks waiting | tasks finished | running |" << std::endl;
-            for(auto threadPair : threads)
-            {
-              std::string type = Thread::TypeName[threadPair.second->Type()];
-              std::string spaces = "";
-              int count = Thread::TypeName[2].size() - type.size();
-              for(int i = 0; i < count; i++)
-                spaces += " ";
-              std::cout 
-                << " " << threadPair.second->ID() << "    " << type << spaces << "     "
-                << threadPair.second->NumTasks() << "           " << threadPair.second->NumWaitingTasks() 
-                << "               " << threadPair.second->NumFinishedTasks() 
-                << "              " 
-                << (threadPair.second->GetRunningTask() == nullptr ? "no" : "yes") << std::endl; 
-            }
+            listThreads();
           }
           else
           {
-            if(args[0] == "list")
+            if(args[0] == "balance" || args[0] == "b")
+            {
+              if(args.size() > 1 && (args[1] == "on" || args[1] == "off"))
+              {
+                std::lock_guard<std::mutex> guard(tickLock);
+                balancing = args[1] == "on";
+              }
+              else if(args.size() > 1)
+                std::cout << "thread: invalid argument '" << args[1] << "'\n";
+              std::cout << "work stealing: " << (balancing ? "on" : "off") << std::endl;
+            }
+            else if(args[0] == "fit" || args[0] == "f")
+            {
+              try
+              {
+                if(args.size() < 3 || (args[2] != "on" && args[2] != "off"))
+                  throw std::invalid_argument("fit");
+                auto threadIt = threads.find(std::stoull(args[1]));
+                if(threadIt == threads.end())
+                  std::cout << "thread: invalid Thread ID '" << args[1] << "'\n";
+                else
+                  threadIt->second->SetPreferFit(args[2] == "on");
+              }
+              catch(const std::exception&)
+              {
+                std::cout << "Usage: thread f[it] <thread id> on|off\n";
+              }
+            }
+            else if(args[0] == "retain" || args[0] == "r")
+            {
+              try
+              {
+                if(args.size() < 2)
+                  throw std::invalid_argument("retain");
+                auto threadIt = threads.find(std::stoull(args[1]));
+                if(threadIt == threads.end())
+                  std::cout << "thread: invalid Thread ID '" << args[1] << "'\n";
+                else
+                {
+                  Thread* thread = threadIt->second;
+                  if(args.size() > 2)
+                    thread->SetRetention(std::stoull(args[2]), args.size() > 3 ? std::stoull(args[3]) : 0);
+                  Thread::History history = thread->GetHistory();
+                  std::cout << "thread " << thread->ID() << ": keeps " << thread->RetainCount() << " finished tasks";
+                  if(thread->RetainAge() > 0)
+                    std::cout << " for " << thread->RetainAge() << " time units";
+                  std::cout << ", " << thread->NumRetainedTasks() << " kept, dropped " << history.done
+                            << " done and " << history.killed << " killed" << std::endl;
+                }
+              }
+              catch(const std::exception&)
+              {
+                std::cout << "Usage: thread r[etain] <thread id> [count [age]]\n";
+              }
+            }
+            else if(args[0] == "locks" || args[0] == "l")
+            {
+              if(args.size() > 1 && args[1] == "reset")
+              {
+                for(auto threadPair : threads)
+                  threadPair.second->ResetLockStats();
+              }
+              else
+              {
+                std::cout << " ID | acquisitions | contended | total wait (us) | max wait (us) |" << std::endl;
+                for(auto threadPair : threads)
+                {
+                  AdaptiveMutex::Stats stats = threadPair.second->LockStats();
+                  std::cout
+                    << " " << threadPair.second->ID() << "    " << stats.acquisitions
+                    << "    " << stats.contended << "    " << stats.waitNanos / 1000
+                    << "    " << stats.maxWaitNanos / 1000 << std::endl;
+                }
+              }
+            }
+            else if(args[0] == "stats" || args[0] == "s")
+            {
+              if(args.size() < 2)
+                showStats(nullptr);
+              else
+              {
+                try
+                {
+                  auto threadIt = threads.find(std::stoull(args[1]));
+                  if(threadIt == threads.end())
+                    std::cout << "thread: invalid Thread ID '" << args[1] << "'\n";
+                  else
+                    showStats(threadIt->second);
+                }
+                catch(const std::exception&)
+                {
+                  std::cout << "Usage: thread s[tats] [thread id]\n";
+                }
+              }
+            }
+            else if(args[0] == "alloc" || args[0] == "a")
+            {
+              std::cout << " ID | tasks | free rows | allocations | name chunks | name bytes used | name bytes held | compactions |" << std::endl;
+              for(auto threadPair : threads)
+              {
+                TaskTable::AllocStats stats = threadPair.second->AllocStats();
+                std::cout
+                  << " " << threadPair.second->ID() << "    " << stats.rows
+                  << "    " << stats.freeRows << "    " << stats.allocations
+                  << "    " << stats.arenaChunks << "    " << stats.arenaUsed
+                  << "    " << stats.arenaReserved << "    " << stats.compactions << std::endl;
+              }
+            }
+            else if(args[0] == "inbox" || args[0] == "i")
             {
-              std::cout << " ID |           type         | num tasks | tasks waiting | tasks finished | running |" << std::endl;
+              std::cout << " ID | submitted | queued | rejected | largest drain |" << std::endl;
               for(auto threadPair : threads)
               {
-                std::string type = Thread::TypeName[threadPair.second->Type()];
-                std::string spaces = "";
-                int count = Thread::TypeName[2].size() - type.size();
-                for(int i = 0; i < count; i++)
-                  spaces += " ";
-                std::cout 
-                  << " " << threadPair.second->ID() << "    " << type << spaces << "     "
-                  << threadPair.second->NumTasks() << "           " << threadPair.second->NumWaitingTasks() 
-                  << "               " << threadPair.second->NumFinishedTasks() 
-                  << "              " 
-                  << (threadPair.second->GetRunningTask() == nullptr ? "no" : "yes") << std::endl; 
+                Thread::SubmitStats stats = threadPair.second->GetSubmitStats();
+                std::cout
+                  << " " << threadPair.second->ID() << "    " << stats.submitted
+                  << "    " << stats.queued << "    " << stats.rejected
+                  << "    " << stats.largestDrain << std::endl;
+              }
+            }
+            else if(args[0] == "workers" || args[0] == "w")
+            {
+              if(args.size() < 2)
+              {
+                std::cout << "host workers: " << (workers == nullptr ? 0 : workers->Size())
+                          << (workers == nullptr ? " (serial)" : "") << std::endl;
+              }
+              else
+              {
+                try
+                {
+                  int count = std::stoi(args[1]);
+                  if(count < 0)
+                    throw std::exception();
+                  std::lock_guard<std::mutex> guard(tickLock);
+                  delete workers;
+                  workers = count == 0 ? nullptr : new WorkerPool(count);
+                }
+                catch(const std::exception&)
+                {
+                  std::cout << "thread: invalid worker count '" << args[1] << "'\n";
+                }
               }
             }
             else if(args.size() < 2)
@@ -1203,10 +2457,22 @@ namespace Shell
                 try
                 {
                   Thread::ScheduleType type = static_cast<Thread::ScheduleType>(std::stoi(args[1]));
-                  if(type < Thread::fifo || type > Thread::shortestprocess)
+                  if(type < Thread::fifo || type > Thread::shortestremaining)
                     throw std::exception();
-                  Thread* thread = new Thread(1000000, type);
-                  threads.emplace(thread->ID(), thread);
+                  ull quantum = Thread::DEFAULT_QUANTUM;
+                  if(args.size() > 2)
+                  {
+                    long long q = std::stoll(args[2]);
+                    if(q < 1)
+                    {
+                      std::cout << "thread: invalid quantum '" << args[2] << "'\n";
+                      return true;
+                    }
+                    quantum = q;
+                  }
+                  Thread* thread = new Thread(1000000, type, quantum);
+                  std::lock_guard<std::mutex> guard(tickLock);
+                  addThread(thread);
                 }
                 catch(const std::exception)
                 {
@@ -1228,6 +2494,14 @@ namespace Shell
                   }
                   else
                   {
+                    std::lock_guard<std::mutex> guard(tickLock);
+                    if(tracer != nullptr)
+                      drainTrace();
+                    // its tasks go with it, so take them off the monitor
+                    std::vector<process> kills;
+                    for(const TaskRecord& t : threads[id]->LiveTasks())
+                      kills.push_back(killRecord(t.id));
+                    queueUpdates(kills);
                     delete threads[id];
                     threads.erase(id);
                   }
@@ -1349,11 +2623,58 @@ namespace Shell
           {
             std::cout << "Usage: switchto user : attempts to switch users, users with passwords will be prompted\n";
           }
+          else if(args[0] == "load")
+          {
+            std::cout << "Usage: load file : loads threads and tasks from a workload file\n";
+            std::cout << "Usage: load -b file : loads threads and tasks from a binary workload file\n";
+            std::cout << "Usage: load -c in out : converts a workload file from text to binary or from binary to text\n";
+            std::cout << "  format: <thread count>, then <id> <type> <memory> [quantum] per thread,\n"
+                      << "          <task count>, then <name> <time> <memory> <thread id> [arrival] per task\n"
+                      << "  arrival is the simulated time after loading the task is submitted at, 0 or none submits it right away\n";
+          }
+          else if(args[0] == "trace")
+          {
+            std::cout << "Usage: trace : shows if scheduler events are being recorded\n";
+            std::cout << "Usage: trace start <file> : records the add, dispatch, preempt, block, finish, kill"
+                      << " and work stealing events of every thread to a binary file\n";
+            std::cout << "Usage: trace stop : stops recording and closes the file\n";
+            std::cout << "Usage: trace replay <file> [type id] : re-runs the adds, kills and steals of a trace on fresh threads"
+                      << " at full speed, optionally all with another schedule type, and compares the result\n";
+          }
+          else if(args[0] == "monitor")
+          {
+            std::cout << "Usage: monitor : shows how many task updates were queued for the task monitor and how many"
+                      << " records were published after merging the updates of each task\n";
+            std::cout << "Usage: monitor policy block|drop-oldest|coalesce : sets what happens to a task update when"
+                      << " the queue to the task monitor is full, wait for room, drop the oldest update, or drop"
+                      << " it if it is a change and wait otherwise, a wait gives up and drops the update after "
+                      << UPDATE_WAIT.count() << "ms. Dropping a new or finished task makes the shell send every"
+                      << " task to the monitor again\n";
+          }
+          else if(args[0] == "fastforward" || args[0] == "ff")
+          {
+            std::cout << "Usage: f[ast]f[orward] [file] : loads the file if given then runs every thread until "
+                      << "all tasks are done without waiting between events, printing turnaround statistics\n";
+          }
           else if(args[0] == "thread")
           {
             std::cout << "Usage: thread [list] : lists all current threads available to the computer\n";
-            std::cout << "Usage: thread c[reate] <type id> : creates a thread with given scheduling type\n";
+            std::cout << "Usage: thread c[reate] <type id> [quantum] : creates a thread with given scheduling type"
+                      << " (0 fifo, 1 round robin, 2 shortest process first, 3 multilevel feedback,"
+                      << " 4 shortest remaining first), quantum defaults to "
+                      << Thread::DEFAULT_QUANTUM << "\n";
             std::cout << "Usage: thread d[elete] <thread id> : killed the thread with the given id\n";
+            std::cout << "Usage: thread l[ocks] [reset] : shows or resets lock contention counters of each thread\n";
+            std::cout << "Usage: thread a[lloc] : shows the task table allocation counters of each thread\n";
+            std::cout << "Usage: thread i[nbox] : shows how many tasks were submitted to each thread without its lock"
+                      << " and how many are still queued\n";
+            std::cout << "Usage: thread s[tats] [thread id] : shows wait, response and turnaround times and throughput"
+              << " of each thread and policy, or of one thread\n";
+            std::cout << "Usage: thread r[etain] <thread id> [count [age]] : shows or sets how many finished tasks a thread keeps"
+                      << " and for how long, older ones are dropped\n";
+            std::cout << "Usage: thread f[it] <thread id> on|off : lets tasks waiting for memory that fit skip ahead of ones that don't\n";
+            std::cout << "Usage: thread b[alance] [on|off] : shows or sets if idle threads steal waiting tasks from busy ones\n";
+            std::cout << "Usage: thread w[orkers] [count] : shows or sets the number of host threads updating the threads, 0 updates them serially\n";
           }
           else 
           {
@@ -1375,10 +2696,16 @@ namespace Shell
           {
             if(args.size() < 1)
             {
-              Task* t = new Task(file->GetTask());
-              threads[0]->AddTask(t);
-              newTask(t->Name(), t->ID(), 0, t->MemoryUsage(), t->TimeRemaining());
-              std::cout << file->Name() << " executed\n";
+              Task t = file->GetTask().Spawn();
+              if(!threads[0]->AddTask(t))
+              {
+                std::cout << command << ": not enough memory on thread 0\n";
+              }
+              else
+              {
+                newTask(t.Name(), t.ID(), 0, t.MemoryUsage(), t.TimeRemaining());
+                std::cout << file->Name() << " executed\n";
+              }
             }
             else
             {
@@ -1392,10 +2719,16 @@ namespace Shell
                 }
                 else
                 {
-                  Task* t = new Task(file->GetTask());
-                  itemIt->second->AddTask(t);
-                  newTask(t->Name(), t->ID(), id, t->MemoryUsage(), t->TimeRemaining());
-                  std::cout << file->Name() << " executed\n";
+                  Task t = file->GetTask().Spawn();
+                  if(!itemIt->second->AddTask(t))
+                  {
+                    std::cout << command << ": not enough memory on thread " << id << "\n";
+                  }
+                  else
+                  {
+                    newTask(t.Name(), t.ID(), id, t.MemoryUsage(), t.TimeRemaining());
+                    std::cout << file->Name() << " executed\n";
+                  }
                 }
               }
               catch(const std::exception& e)
@@ -1501,13 +2834,7 @@ namespace Shell
        */
       void updateTask(int id, int memory, ull time)
       {
-        process newProcess;
-        newProcess.id = id;
-        newProcess.threadId = -1;
-        newProcess.memory = (time == 0) ? 0 : memory;
-        // newProcess.cpu = cpu;
-        newProcess.time = time;
-        processesToUpdate.push(newProcess);
+        queueUpdate(updateRecord(id, memory, time));
       }
 
       /**
@@ -1515,13 +2842,7 @@ namespace Shell
        */
       void killTask(int id)
       {
-        process newProcess;
-        newProcess.id = id;
-        newProcess.threadId = -1;
-        newProcess.memory = 0;
-        // newProcess.cpu = cpu;
-        newProcess.time = 0;
-        processesToUpdate.push(newProcess);
+        queueUpdate(killRecord(id));
       }
 
       /**
@@ -1534,6 +2855,123 @@ namespace Shell
           return;
         }
 
+        queueUpdate(newRecord(name, id, threadId, memory, time));
+
+        return;
+      }
+
+      /**
+       * queues an update for the client and wakes it
+       */
+      void queueUpdate(process update)
+      {
+        pushUpdate(update, std::chrono::steady_clock::now() + UPDATE_WAIT);
+        wakeClient();
+      }
+
+      /**
+       * queues a list of updates waking the client once
+       */
+      void queueUpdates(const std::vector<process>& updates)
+      {
+        if(updates.empty())
+          return;
+        // one deadline for the batch, so a stalled client costs a tick
+        // at most UPDATE_WAIT however many updates it has
+        auto deadline = std::chrono::steady_clock::now() + UPDATE_WAIT;
+        for(const process& update : updates)
+        {
+          process copy = update;
+          pushUpdate(copy, deadline);
+        }
+        wakeClient();
+      }
+
+      /**
+       * Puts an update in processesToUpdate, following updatePolicy if it
+       * is full
+       * @param  deadline  when to stop waiting for room and drop it
+       * @return  false if the update was dropped
+       */
+      bool pushUpdate(process& update, std::chrono::steady_clock::time_point deadline)
+      {
+        while(!processesToUpdate.TryPush(update))
+        {
+          int policy = updatePolicy;
+          if(policy == dropOldest)
+          {
+            process oldest;
+            if(processesToUpdate.TryPop(oldest))
+              dropUpdate(oldest);
+            continue;
+          }
+          // a stopped client takes nothing, don't wait for it
+          if((policy == coalesce && update.threadId == -1 && update.time != 0) ||
+             !running || std::chrono::steady_clock::now() >= deadline)
+          {
+            dropUpdate(update);
+            return false;
+          }
+          wakeClient();
+          std::unique_lock<std::mutex> guard(updateLock);
+          roomWaiters++;
+          // the client may have made room before it could see us waiting
+          if(processesToUpdate.Size() >= processesToUpdate.Capacity())
+            roomReady.wait_until(guard, deadline);
+          roomWaiters--;
+        }
+        queuedCount++;
+        ull depth = processesToUpdate.Size();
+        ull deepest = maxDepth;
+        while(depth > deepest && !maxDepth.compare_exchange_weak(deepest, depth));
+        return true;
+      }
+
+      /**
+       * counts an update that never reaches the client, an add or kill
+       * makes the client resend every task
+       */
+      void dropUpdate(const process& update)
+      {
+        droppedCount++;
+        if(update.threadId != -1 || update.time == 0)
+          resyncNeeded = true;
+      }
+
+      /**
+       * wakes the client if it sleeps, must follow pushing the updates
+       */
+      void wakeClient()
+      {
+        // pairs with the fence the client puts between setting
+        // clientWaiting and checking the queue
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(clientWaiting)
+        {
+          std::lock_guard<std::mutex> guard(updateLock);
+          updateReady.notify_one();
+        }
+      }
+
+      /**
+       * builds the update record of a task
+       */
+      static process updateRecord(int id, int memory, ull time)
+      {
+        process newProcess;
+        newProcess.id = id;
+        newProcess.threadId = -1;
+        newProcess.memory = (time == 0) ? 0 : memory;
+        // newProcess.cpu = cpu;
+        newProcess.time = time;
+        return newProcess;
+      }
+
+      /**
+       * builds the record of a new task
+       */
+      static process newRecord(std::string name, int id, int threadId, int memory, ull time)
+      {
         process newProcess;
         newProcess.name = name;
         newProcess.id = id;
@@ -1541,9 +2979,21 @@ namespace Shell
         newProcess.memory = memory;
         // newProcess.cpu = cpu;
         newProcess.time = time;
-        processesToUpdate.push(newProcess);
+        return newProcess;
+      }
 
-        return;
+      /**
+       * builds the record of a task that is gone
+       */
+      static process killRecord(int id)
+      {
+        process newProcess;
+        newProcess.id = id;
+        newProcess.threadId = -1;
+        newProcess.memory = 0;
+        // newProcess.cpu = cpu;
+        newProcess.time = 0;
+        return newProcess;
       }
   };
 }
@@ -0,0 +1,103 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+#include <vector>
+#include <algorithm>
+#ifndef ull
+#define ull unsigned long long
+#endif
+
+namespace Shell
+{
+  /**
+   * @brief Log-linear histogram of simulated times for percentiles
+   *
+   * Values below SUB_BUCKETS are counted exactly. Above that every power of
+   * two is split into SUB_BUCKETS equal buckets, so a reported percentile is
+   * within about 1/SUB_BUCKETS of the real value while the memory used only
+   * grows with the log of the largest value recorded.
+   */
+  class Histogram
+  {
+    private:
+      static const unsigned int SUB_BITS = 5;
+      static const ull SUB_BUCKETS = 1ULL << SUB_BITS;
+      std::vector<ull> buckets;
+      ull count;
+      ull total;
+      ull max;
+
+      static size_t bucketOf(ull value)
+      {
+        if(value < SUB_BUCKETS)
+          return value;
+        unsigned int exponent = 63 - __builtin_clzll(value);
+        unsigned int shift = exponent - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS);
+      }
+      /** returns the largest value that falls in a bucket */
+      static ull highest(size_t bucket)
+      {
+        if(bucket < SUB_BUCKETS)
+          return bucket;
+        unsigned int shift = bucket / SUB_BUCKETS - 1;
+        ull low = (SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+        return low + ((1ULL << shift) - 1);
+      }
+
+    public:
+      Histogram() : count(0), total(0), max(0) {}
+      /** adds a value */
+      void Record(ull value)
+      {
+        size_t bucket = bucketOf(value);
+        if(bucket >= buckets.size())
+          buckets.resize(bucket + 1, 0);
+        buckets[bucket]++;
+        count++;
+        total += value;
+        max = std::max(max, value);
+      }
+      /** adds every value of another histogram */
+      void Merge(const Histogram& other)
+      {
+        if(other.buckets.size() > buckets.size())
+          buckets.resize(other.buckets.size(), 0);
+        for(size_t i = 0; i < other.buckets.size(); i++)
+          buckets[i] += other.buckets[i];
+        count += other.count;
+        total += other.total;
+        max = std::max(max, other.max);
+      }
+      void Reset()
+      {
+        buckets.clear();
+        count = 0;
+        total = 0;
+        max = 0;
+      }
+      ull Count() const { return count; }
+      ull Max() const { return max; }
+      double Mean() const { return count == 0 ? 0 : static_cast<double>(total) / count; }
+      /**
+       * Value at a percentile
+       * @param  p  percentile between 0 and 100
+       * @return  upper bound of the bucket holding it, never above Max
+       */
+      ull Percentile(double p) const
+      {
+        if(count == 0)
+          return 0;
+        ull rank = static_cast<ull>(p / 100.0 * count + 0.5);
+        rank = std::max<ull>(rank, 1);
+        ull seen = 0;
+        for(size_t i = 0; i < buckets.size(); i++)
+        {
+          seen += buckets[i];
+          if(seen >= rank)
+            return std::min(highest(i), max);
+        }
+        return max;
+      }
+  };
+}
+#endif
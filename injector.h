@@ -0,0 +1,114 @@
+#ifndef INJECTOR_H
+#define INJECTOR_H
+#include <vector>
+#include <queue>
+#include <functional>
+#include <string>
+#ifndef ull
+#define ull unsigned long long
+#endif
+
+namespace Shell
+{
+  /**
+   * @brief Holds tasks until the simulated time they arrive at
+   *
+   * Arrivals are kept in a min-heap on their time, so finding the next one
+   * is O(1) and releasing one is O(log n) no matter how many are waiting.
+   * Arrivals with the same time are released in the order they were added.
+   */
+  class Injector
+  {
+    public:
+      /**
+       * a task waiting to be submitted
+       */
+      struct Arrival
+      {
+        /** simulated time it is released at */
+        ull time;
+        /** id of the thread it goes to */
+        ull threadId;
+        std::string name;
+        ull processTime;
+        ull memory;
+      };
+
+    private:
+      struct Entry
+      {
+        ull time;
+        ull seq;
+        size_t index;
+        bool operator>(const Entry& other) const
+        {
+          return time > other.time || (time == other.time && seq > other.seq);
+        }
+      };
+      std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+      /**
+       * the arrivals, heap entries refer to them by index
+       */
+      std::vector<Arrival> arrivals;
+      /**
+       * slots of arrivals that were released and can be reused
+       */
+      std::vector<size_t> freeSlots;
+      ull sequence;
+
+    public:
+      Injector() : sequence(0) {}
+      /** returns the number of tasks still to arrive */
+      size_t Size() const { return heap.size(); }
+      bool Empty() const { return heap.empty(); }
+      /** returns the time of the next arrival, must not be empty */
+      ull NextTime() const { return heap.top().time; }
+      /** queues a task to be released at arrival.time */
+      void Schedule(const Arrival& arrival)
+      {
+        Entry e;
+        e.time = arrival.time;
+        e.seq = sequence++;
+        if(freeSlots.empty())
+        {
+          e.index = arrivals.size();
+          arrivals.push_back(arrival);
+        }
+        else
+        {
+          e.index = freeSlots.back();
+          freeSlots.pop_back();
+          arrivals[e.index] = arrival;
+        }
+        heap.push(e);
+      }
+      /**
+       * Removes every arrival due by a time
+       * @param  now  current simulated time
+       * @param  due  the released arrivals are appended here in order
+       */
+      void Release(ull now, std::vector<Arrival>& due)
+      {
+        while(!heap.empty() && heap.top().time <= now)
+        {
+          size_t index = heap.top().index;
+          heap.pop();
+          due.push_back(arrivals[index]);
+          freeSlots.push_back(index);
+        }
+        if(heap.empty())
+        {
+          arrivals.clear();
+          freeSlots.clear();
+        }
+      }
+      /** drops every arrival */
+      void Clear()
+      {
+        heap = decltype(heap)();
+        arrivals.clear();
+        freeSlots.clear();
+      }
+  };
+}
+#endif
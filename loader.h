@@ -0,0 +1,474 @@
+#ifndef LOADER_H
+#define LOADER_H
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifndef ull
+#define ull unsigned long long
+#endif
+
+namespace Shell
+{
+  /**
+   * @brief Layout of the binary workload format
+   *
+   * A Header, then threadCount ThreadEntry, then taskCount TaskEntry, then
+   * the string table holding the task names back to back. Every record has
+   * a fixed width and is stored in host byte order, endian tells a reader
+   * if the file was written on a machine with another order.
+   */
+  namespace BinaryWorkload
+  {
+    const char MAGIC[4] = {'S', 'H', 'W', 'L'};
+    const uint32_t VERSION = 1;
+    const uint32_t ENDIAN = 0x01020304;
+    struct Header
+    {
+      char magic[4];
+      uint32_t version;
+      uint32_t endian;
+      uint32_t threadCount;
+      uint64_t taskCount;
+      uint64_t stringBytes;
+    };
+    struct ThreadEntry
+    {
+      uint64_t id;
+      uint64_t memory;
+      uint64_t quantum;
+      uint32_t type;
+      uint32_t reserved;
+    };
+    struct TaskEntry
+    {
+      uint64_t time;
+      uint64_t memory;
+      uint64_t threadId;
+      uint64_t arrival;
+      /** position of the name in the string table */
+      uint64_t nameOffset;
+      uint32_t nameLength;
+      uint32_t reserved;
+    };
+    /** returns if a file starts like a binary workload */
+    inline bool Is(const char* data, size_t size)
+    {
+      return size >= sizeof(MAGIC) && std::equal(MAGIC, MAGIC + sizeof(MAGIC), data);
+    }
+  }
+
+  /**
+   * @brief Read only memory mapping of a whole file
+   *
+   * Pages are faulted in as they are read. Release lets the kernel drop the
+   * pages already parsed, so reading a file far larger than memory keeps
+   * the resident size bounded.
+   */
+  class MappedFile
+  {
+    private:
+      const char* data;
+      size_t size;
+      size_t released;
+      std::string error;
+
+    public:
+      /**
+       * Maps a file
+       * @param  path  file to map, Error tells why if it could not be
+       */
+      explicit MappedFile(const std::string& path) : data(nullptr), size(0), released(0)
+      {
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if(fd < 0)
+          error = "cannot open " + path;
+        else if(fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+          error = path + " is not a regular file";
+        else if(info.st_size > 0)
+        {
+          void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+          if(mapped == MAP_FAILED)
+            error = "cannot map " + path;
+          else
+          {
+            data = static_cast<const char*>(mapped);
+            size = info.st_size;
+            madvise(mapped, size, MADV_SEQUENTIAL);
+          }
+        }
+        if(fd >= 0)
+          close(fd);
+      }
+      MappedFile(const MappedFile&) = delete;
+      MappedFile& operator=(const MappedFile&) = delete;
+      ~MappedFile()
+      {
+        if(data != nullptr)
+          munmap(const_cast<char*>(data), size);
+      }
+      const std::string& Error() const { return error; }
+      const char* Data() const { return data; }
+      size_t Size() const { return size; }
+      /**
+       * Drops the pages before an offset from memory, they are read back
+       * from the file if touched again
+       */
+      void Release(size_t offset)
+      {
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t end = offset / page * page;
+        if(data == nullptr || end <= released)
+          return;
+        madvise(const_cast<char*>(data) + released, end - released, MADV_DONTNEED);
+        released = end;
+      }
+  };
+
+  /**
+   * @brief Streaming parser of load workload files
+   *
+   * Walks a MappedFile once, line by line, handing every thread and task
+   * row to a callback as soon as it is parsed, so nothing but the current
+   * line is held. The format is a thread count, that many thread rows of
+   * "<id> <type> <memory> [quantum]", a task count and that many task rows
+   * of "<name> <time> <memory> <thread id> [arrival]". Blank lines are
+   * skipped, rows that do not parse are reported with their line number.
+   */
+  class WorkloadParser
+  {
+    public:
+      struct ThreadRow
+      {
+        ull id;
+        int type;
+        ull memory;
+        /** 0 if the row has none */
+        ull quantum;
+      };
+      struct TaskRow
+      {
+        /** points into the file, not NUL terminated */
+        const char* name;
+        size_t nameLength;
+        ull time;
+        ull memory;
+        ull threadId;
+        ull arrival;
+      };
+      std::function<void(const ThreadRow&)> OnThread;
+      std::function<void(const TaskRow&)> OnTask;
+      /** called with the line number of a row that could not be used,
+       *  the record number for binary files */
+      std::function<void(ull, const std::string&)> OnError;
+      /** called every PROGRESS_RECORDS records with the count so far */
+      std::function<void(ull)> OnProgress;
+
+      static const ull PROGRESS_RECORDS = 1000000;
+      /**
+       * bytes parsed between releasing pages of the file
+       */
+      static const size_t RELEASE_BYTES = 64 * 1024 * 1024;
+
+    private:
+      const char* cursor;
+      const char* lineEnd;
+      const char* end;
+
+      static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+      void skipSpace()
+      {
+        while(cursor < lineEnd && isSpace(*cursor))
+          cursor++;
+      }
+      /** reads the next whitespace separated field of the line */
+      bool field(const char*& start, size_t& length)
+      {
+        skipSpace();
+        start = cursor;
+        while(cursor < lineEnd && !isSpace(*cursor))
+          cursor++;
+        length = cursor - start;
+        return length > 0;
+      }
+      bool number(ull& value)
+      {
+        const char* start;
+        size_t length;
+        if(!field(start, length) || length > 19)
+          return false;
+        value = 0;
+        for(size_t i = 0; i < length; i++)
+        {
+          if(start[i] < '0' || start[i] > '9')
+            return false;
+          value = value * 10 + (start[i] - '0');
+        }
+        return true;
+      }
+      /** returns if nothing but whitespace is left on the line */
+      bool atEnd()
+      {
+        skipSpace();
+        return cursor == lineEnd;
+      }
+
+    public:
+      /**
+       * Parses a whole file
+       * @return  number of thread and task rows read, good or bad
+       */
+      ull Parse(MappedFile& file)
+      {
+        enum {threadCount, threads, taskCount, tasks, done} state = threadCount;
+        ull expected = 0, seen = 0, records = 0, lineNumber = 0;
+        const char* lastRelease = file.Data();
+        cursor = file.Data();
+        end = cursor + file.Size();
+        while(cursor < end && state != done)
+        {
+          lineNumber++;
+          lineEnd = static_cast<const char*>(memchr(cursor, '\n', end - cursor));
+          if(lineEnd == nullptr)
+            lineEnd = end;
+          if(atEnd())
+          {
+            cursor = lineEnd + 1;
+            continue;
+          }
+          if(state == threadCount || state == taskCount)
+          {
+            if(number(expected) && atEnd())
+            {
+              seen = 0;
+              state = state == threadCount ? (expected > 0 ? threads : taskCount) : (expected > 0 ? tasks : done);
+            }
+            else if(OnError)
+              OnError(lineNumber, state == threadCount ? "expected the thread count" : "expected the task count");
+          }
+          else if(state == threads)
+          {
+            ThreadRow row;
+            ull type;
+            row.quantum = 0;
+            if(number(row.id) && number(type) && number(row.memory) && (atEnd() || (number(row.quantum) && atEnd())))
+            {
+              row.type = type;
+              if(OnThread)
+                OnThread(row);
+            }
+            else if(OnError)
+              OnError(lineNumber, "bad thread row, expected <id> <type> <memory> [quantum]");
+            if(++records % PROGRESS_RECORDS == 0 && OnProgress)
+              OnProgress(records);
+            if(++seen == expected)
+              state = taskCount;
+          }
+          else
+          {
+            TaskRow row;
+            row.arrival = 0;
+            if(field(row.name, row.nameLength) && number(row.time) && number(row.memory) && number(row.threadId) &&
+               (atEnd() || (number(row.arrival) && atEnd())))
+            {
+              if(OnTask)
+                OnTask(row);
+            }
+            else if(OnError)
+              OnError(lineNumber, "bad task row, expected <name> <time> <memory> <thread id> [arrival]");
+            if(++records % PROGRESS_RECORDS == 0 && OnProgress)
+              OnProgress(records);
+            if(++seen == expected)
+              state = done;
+          }
+          cursor = lineEnd + 1;
+          if(static_cast<size_t>(cursor - lastRelease) >= RELEASE_BYTES)
+          {
+            file.Release(cursor - file.Data());
+            lastRelease = cursor;
+          }
+        }
+        if(state != done && OnError)
+        {
+          if(state == threads || state == tasks)
+            OnError(lineNumber, "file ends after " + std::to_string(seen) + " of " + std::to_string(expected) +
+                    (state == threads ? " threads" : " tasks"));
+          else if(state == taskCount && lineNumber > 0)
+            OnError(lineNumber, "file ends before the task count");
+        }
+        return records;
+      }
+      /**
+       * Parses a whole binary workload, see BinaryWorkload
+       * @return  number of thread and task records read, good or bad
+       */
+      ull ParseBinary(MappedFile& file)
+      {
+        using namespace BinaryWorkload;
+        const char* data = file.Data();
+        size_t size = file.Size();
+        Header header;
+        if(size < sizeof(header) || !Is(data, size))
+        {
+          if(OnError)
+            OnError(0, "not a binary workload");
+          return 0;
+        }
+        std::memcpy(&header, data, sizeof(header));
+        if(header.endian != ENDIAN || header.version != VERSION)
+        {
+          if(OnError)
+            OnError(0, header.endian != ENDIAN ? "binary workload has another byte order" : "unsupported binary workload version");
+          return 0;
+        }
+        size_t threadBytes = header.threadCount * sizeof(ThreadEntry);
+        size_t taskStart = sizeof(header) + threadBytes;
+        size_t stringStart = taskStart + header.taskCount * sizeof(TaskEntry);
+        if(header.taskCount > size / sizeof(TaskEntry) || header.stringBytes > size || stringStart + header.stringBytes != size)
+        {
+          if(OnError)
+            OnError(0, "binary workload has the wrong size for its counts");
+          return 0;
+        }
+        const char* strings = data + stringStart;
+        ull records = 0;
+        for(uint32_t i = 0; i < header.threadCount; i++)
+        {
+          ThreadEntry entry;
+          std::memcpy(&entry, data + sizeof(header) + i * sizeof(entry), sizeof(entry));
+          ThreadRow row;
+          row.id = entry.id;
+          row.type = entry.type;
+          row.memory = entry.memory;
+          row.quantum = entry.quantum;
+          if(OnThread)
+            OnThread(row);
+          records++;
+        }
+        size_t lastRelease = taskStart;
+        for(uint64_t i = 0; i < header.taskCount; i++)
+        {
+          TaskEntry entry;
+          size_t offset = taskStart + i * sizeof(entry);
+          std::memcpy(&entry, data + offset, sizeof(entry));
+          if(entry.nameOffset > header.stringBytes || entry.nameLength > header.stringBytes - entry.nameOffset || entry.nameLength == 0)
+          {
+            if(OnError)
+              OnError(records + 1, "task name is outside of the string table");
+          }
+          else if(OnTask)
+          {
+            TaskRow row;
+            row.name = strings + entry.nameOffset;
+            row.nameLength = entry.nameLength;
+            row.time = entry.time;
+            row.memory = entry.memory;
+            row.threadId = entry.threadId;
+            row.arrival = entry.arrival;
+            OnTask(row);
+          }
+          if(++records % PROGRESS_RECORDS == 0 && OnProgress)
+            OnProgress(records);
+          // the string table is still needed, only drop task records
+          if(offset - lastRelease >= RELEASE_BYTES)
+          {
+            file.Release(offset);
+            lastRelease = offset;
+          }
+        }
+        return records;
+      }
+  };
+
+  /**
+   * @brief Writes a binary workload one record at a time
+   *
+   * Thread rows must all come before the first task row. Task records are
+   * streamed to the file, names are collected into the string table that
+   * is appended by Finish, which also fills in the header.
+   */
+  class WorkloadWriter
+  {
+    private:
+      std::ofstream out;
+      BinaryWorkload::Header header;
+      std::vector<BinaryWorkload::ThreadEntry> threads;
+      std::string strings;
+      bool tasksStarted;
+
+      void writeHead()
+      {
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(threads.data()), threads.size() * sizeof(BinaryWorkload::ThreadEntry));
+      }
+
+    public:
+      explicit WorkloadWriter(const std::string& path) : out(path, std::ios::binary | std::ios::trunc), tasksStarted(false)
+      {
+        std::memset(&header, 0, sizeof(header));
+        std::copy(BinaryWorkload::MAGIC, BinaryWorkload::MAGIC + sizeof(header.magic), header.magic);
+        header.version = BinaryWorkload::VERSION;
+        header.endian = BinaryWorkload::ENDIAN;
+      }
+      bool Good() const { return out.good(); }
+      /** adds a thread, false once tasks were added */
+      bool AddThread(const WorkloadParser::ThreadRow& row)
+      {
+        if(tasksStarted)
+          return false;
+        BinaryWorkload::ThreadEntry entry;
+        entry.id = row.id;
+        entry.memory = row.memory;
+        entry.quantum = row.quantum;
+        entry.type = row.type;
+        entry.reserved = 0;
+        threads.push_back(entry);
+        header.threadCount = threads.size();
+        return true;
+      }
+      void AddTask(const WorkloadParser::TaskRow& row)
+      {
+        if(!tasksStarted)
+        {
+          // room for the header and threads, rewritten by Finish
+          writeHead();
+          tasksStarted = true;
+        }
+        BinaryWorkload::TaskEntry entry;
+        entry.time = row.time;
+        entry.memory = row.memory;
+        entry.threadId = row.threadId;
+        entry.arrival = row.arrival;
+        entry.nameOffset = strings.size();
+        entry.nameLength = row.nameLength;
+        entry.reserved = 0;
+        strings.append(row.name, row.nameLength);
+        out.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+        header.taskCount++;
+      }
+      /**
+       * Writes the string table and the header
+       * @return  if everything was written
+       */
+      bool Finish()
+      {
+        if(!tasksStarted)
+          writeHead();
+        out.write(strings.data(), strings.size());
+        header.stringBytes = strings.size();
+        writeHead();
+        out.close();
+        return !out.fail();
+      }
+  };
+}
+#endif
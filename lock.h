@@ -0,0 +1,133 @@
+#ifndef LOCK_H
+#define LOCK_H
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#ifndef ull
+#define ull unsigned long long
+#endif
+
+namespace Shell
+{
+  /**
+   * @brief Mutex that spins briefly before blocking and keeps contention counters
+   *
+   * Short critical sections (a tick of a Thread, adding a task) are usually
+   * released within a few hundred nanoseconds, so a waiter first spins for a
+   * bounded number of attempts and only then parks on the underlying mutex.
+   * Satisfies BasicLockable/Lockable so it works with std::lock_guard.
+   */
+  class AdaptiveMutex
+  {
+    public:
+      /**
+       * snapshot of the counters of a lock
+       */
+      struct Stats
+      {
+        /** number of times the lock was acquired */
+        ull acquisitions;
+        /** number of acquisitions that had to wait on another holder */
+        ull contended;
+        /** total time spent waiting in nanoseconds */
+        ull waitNanos;
+        /** longest single wait in nanoseconds */
+        ull maxWaitNanos;
+      };
+
+    private:
+      /**
+       * number of try_lock attempts before blocking
+       */
+      static const int SPIN_LIMIT = 64;
+      /**
+       * number of busy attempts before yielding between spins
+       */
+      static const int YIELD_AFTER = 16;
+      std::mutex mtx;
+      /**
+       * set while held, lets spinners avoid hammering the mutex
+       */
+      std::atomic<bool> held;
+      std::atomic<ull> acquisitions;
+      std::atomic<ull> contended;
+      std::atomic<ull> waitNanos;
+      std::atomic<ull> maxWaitNanos;
+
+    public:
+      AdaptiveMutex() : held(false), acquisitions(0), contended(0), waitNanos(0), maxWaitNanos(0) {}
+      AdaptiveMutex(const AdaptiveMutex&) = delete;
+      AdaptiveMutex& operator=(const AdaptiveMutex&) = delete;
+
+      /**
+       * Acquires the lock, spinning for a short while before blocking
+       */
+      void lock()
+      {
+        if(!mtx.try_lock())
+        {
+          auto start = std::chrono::steady_clock::now();
+          bool gotten = false;
+          for(int i = 0; i < SPIN_LIMIT && !gotten; i++)
+          {
+            if(!held.load(std::memory_order_relaxed))
+              gotten = mtx.try_lock();
+            if(!gotten && i >= YIELD_AFTER)
+              std::this_thread::yield();
+          }
+          if(!gotten)
+            mtx.lock();
+          ull waited = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+          contended.fetch_add(1, std::memory_order_relaxed);
+          waitNanos.fetch_add(waited, std::memory_order_relaxed);
+          ull longest = maxWaitNanos.load(std::memory_order_relaxed);
+          while(waited > longest && !maxWaitNanos.compare_exchange_weak(longest, waited, std::memory_order_relaxed));
+        }
+        held.store(true, std::memory_order_relaxed);
+        acquisitions.fetch_add(1, std::memory_order_relaxed);
+      }
+      /**
+       * Attempts to acquire the lock without waiting
+       * @return  true if the lock was acquired
+       */
+      bool try_lock()
+      {
+        if(!mtx.try_lock())
+          return false;
+        held.store(true, std::memory_order_relaxed);
+        acquisitions.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+      /**
+       * Releases the lock, must be held by the caller
+       */
+      void unlock()
+      {
+        held.store(false, std::memory_order_relaxed);
+        mtx.unlock();
+      }
+      /** returns if the lock is currently held by anyone */
+      bool IsLocked() const { return held.load(std::memory_order_relaxed); }
+      /** returns a snapshot of the contention counters */
+      Stats GetStats() const
+      {
+        Stats s;
+        s.acquisitions = acquisitions.load(std::memory_order_relaxed);
+        s.contended = contended.load(std::memory_order_relaxed);
+        s.waitNanos = waitNanos.load(std::memory_order_relaxed);
+        s.maxWaitNanos = maxWaitNanos.load(std::memory_order_relaxed);
+        return s;
+      }
+      /** resets the contention counters */
+      void ResetStats()
+      {
+        acquisitions.store(0, std::memory_order_relaxed);
+        contended.store(0, std::memory_order_relaxed);
+        waitNanos.store(0, std::memory_order_relaxed);
+        maxWaitNanos.store(0, std::memory_order_relaxed);
+      }
+  };
+}
+#endif
@@ -0,0 +1,563 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+#include <atomic>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <poll.h>
+#include <time.h>
+#ifndef ull
+#define ull unsigned long long
+#endif
+
+namespace Shell
+{
+  static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the ring needs address free 64 bit atomics");
+  static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex words must be plain 32 bit integers");
+
+  /**
+   * Sleeps while a shared 32 bit word still holds value
+   * @param  timeoutMs  longest time to sleep in milliseconds
+   */
+  inline void futexWait(std::atomic<uint32_t>& word, uint32_t value, int timeoutMs)
+  {
+    struct timespec timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, value, &timeout, nullptr, 0);
+  }
+  /** wakes every process sleeping on a shared word */
+  inline void futexWake(std::atomic<uint32_t>& word)
+  {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+  }
+
+  /**
+   * @brief Layout of the shared memory ring between shell and taskMonitor
+   *
+   * One producer (the shell's client thread) and one consumer (the
+   * monitor's talker thread). head and tail count every byte ever written
+   * and read, so the free space is always capacity - (head - tail) and
+   * neither side ever rewinds. A message is a Record followed by its
+   * payload, padded to ALIGN. A record that would run past the end of the
+   * buffer is preceded by a WRAP marker and starts over at offset 0.
+   *
+   * Neither side polls: a side that has to wait (the consumer for data,
+   * the producer for room) flags itself as sleeping and sleeps on a futex
+   * word in the header, which the other side bumps and wakes whenever it
+   * moves head or tail while the flag is set.
+   */
+  struct Ring
+  {
+    static const char MAGIC[4];
+    static const uint32_t VERSION = 2;
+    /** name of the shared memory object */
+    static const char* NAME;
+    /** bytes of message data, a power of two */
+    static const uint64_t CAPACITY = 4 * 1024 * 1024;
+    static const uint64_t ALIGN = 8;
+    /** record length marking the rest of the buffer as unused */
+    static const uint32_t WRAP = ~0U;
+    /** longest a side sleeps before checking the other one is still there */
+    static const int WAIT_MS = 100;
+
+    struct Record
+    {
+      uint32_t length;
+      uint32_t reserved;
+      /** number of the message, counts dropped ones too */
+      uint64_t sequence;
+    };
+    struct Header
+    {
+      char magic[4];
+      uint32_t version;
+      uint64_t capacity;
+      /** changes every time a shell starts writing */
+      std::atomic<uint64_t> session;
+      /** bytes written, only stored by the producer */
+      std::atomic<uint64_t> head;
+      /** bytes read, only stored by the consumer */
+      std::atomic<uint64_t> tail;
+      /** messages dropped because the ring was full and no monitor read it */
+      std::atomic<uint64_t> dropped;
+      /** pid of the attached monitor, 0 if none */
+      std::atomic<int32_t> reader;
+      /** bumped by every monitor that attaches */
+      std::atomic<uint32_t> attaches;
+      /** futex words bumped when head and tail move */
+      std::atomic<uint32_t> written;
+      std::atomic<uint32_t> read;
+      /** set while the consumer waits for data and the producer for room */
+      std::atomic<uint32_t> readerSleeping;
+      std::atomic<uint32_t> writerSleeping;
+    };
+
+    static size_t MappedSize() { return sizeof(Header) + CAPACITY; }
+    static uint64_t Padded(uint64_t length) { return (sizeof(Record) + length + ALIGN - 1) & ~(ALIGN - 1); }
+  };
+  const char Ring::MAGIC[4] = {'S', 'H', 'M', 'R'};
+  const char* Ring::NAME = "/shell-monitor";
+  const uint32_t Ring::VERSION;
+  const uint64_t Ring::CAPACITY;
+  const uint64_t Ring::ALIGN;
+  const uint32_t Ring::WRAP;
+  const int Ring::WAIT_MS;
+
+  /**
+   * @brief Producer side of the ring, writes nothing while no monitor is
+   * attached so a monitor never starts on a stale backlog
+   */
+  class RingWriter
+  {
+    private:
+      Ring::Header* header;
+      char* data;
+      uint64_t sequence;
+      /** value of attaches when NewReader last looked */
+      uint32_t attachesSeen;
+
+      void* map(int fd)
+      {
+        void* p = mmap(nullptr, Ring::MappedSize(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        return p == MAP_FAILED ? nullptr : p;
+      }
+
+    public:
+      RingWriter() : header(nullptr), data(nullptr), sequence(0), attachesSeen(0) {}
+      RingWriter(const RingWriter&) = delete;
+      RingWriter& operator=(const RingWriter&) = delete;
+      ~RingWriter() { Close(); }
+      /**
+       * Creates the shared memory object, or takes over the one a monitor
+       * is already waiting on, and starts a new session in it
+       * @return  false if shared memory is not available
+       */
+      bool Open()
+      {
+        int fd = shm_open(Ring::NAME, O_RDWR | O_CREAT, 0600);
+        if(fd < 0)
+          return false;
+        void* p = ftruncate(fd, Ring::MappedSize()) == 0 ? map(fd) : nullptr;
+        close(fd);
+        if(p == nullptr)
+          return false;
+        header = static_cast<Ring::Header*>(p);
+        data = static_cast<char*>(p) + sizeof(Ring::Header);
+        bool fresh = std::memcmp(header->magic, Ring::MAGIC, sizeof(Ring::MAGIC)) != 0 ||
+                     header->version != Ring::VERSION || header->capacity != Ring::CAPACITY;
+        if(fresh)
+        {
+          header->version = Ring::VERSION;
+          header->capacity = Ring::CAPACITY;
+          header->session.store(0);
+          header->reader.store(0);
+          header->attaches.store(0);
+          header->readerSleeping.store(0);
+        }
+        header->head.store(0);
+        header->tail.store(0);
+        header->dropped.store(0);
+        header->writerSleeping.store(0);
+        attachesSeen = header->attaches.load();
+        header->session.fetch_add(1, std::memory_order_release);
+        // the magic goes last so a monitor never sees a half made header
+        std::memcpy(header->magic, Ring::MAGIC, sizeof(Ring::MAGIC));
+        sequence = 0;
+        // a monitor waiting on the ring of an earlier session sees the reset
+        header->written.fetch_add(1);
+        futexWake(header->written);
+        return true;
+      }
+      bool IsOpen() const { return header != nullptr; }
+      /** returns if a live monitor is reading the ring */
+      bool ReaderAttached() const
+      {
+        int32_t pid = header->reader.load(std::memory_order_relaxed);
+        return pid != 0 && kill(pid, 0) == 0;
+      }
+      /**
+       * Tells if a monitor attached since the last call, it only sees
+       * what is written after it attached
+       */
+      bool NewReader()
+      {
+        uint32_t attaches = header->attaches.load(std::memory_order_acquire);
+        if(attaches == attachesSeen)
+          return false;
+        attachesSeen = attaches;
+        return true;
+      }
+      /**
+       * Appends a message if there is room
+       * @return  false if the ring is full, nothing is written then
+       */
+      bool TryWrite(const char* message, size_t length)
+      {
+        uint64_t size = Ring::Padded(length);
+        uint64_t head = header->head.load(std::memory_order_relaxed);
+        uint64_t tail = header->tail.load(std::memory_order_acquire);
+        uint64_t offset = head & (Ring::CAPACITY - 1);
+        uint64_t skip = Ring::CAPACITY - offset < size ? Ring::CAPACITY - offset : 0;
+        if(head + skip + size - tail > Ring::CAPACITY)
+          return false;
+        if(skip > 0)
+        {
+          Ring::Record wrap = Ring::Record();
+          wrap.length = Ring::WRAP;
+          std::memcpy(data + offset, &wrap, sizeof(wrap.length));
+          offset = 0;
+        }
+        Ring::Record record = Ring::Record();
+        record.length = length;
+        record.sequence = sequence++;
+        std::memcpy(data + offset, &record, sizeof(record));
+        std::memcpy(data + offset + sizeof(record), message, length);
+        header->head.store(head + skip + size, std::memory_order_release);
+        header->written.fetch_add(1);
+        if(header->readerSleeping.load())
+          futexWake(header->written);
+        return true;
+      }
+      /**
+       * Appends a message, sleeping until there is room while a monitor
+       * is reading
+       * @return  false if it was dropped because no monitor is attached or
+       *          it does not fit, an attached monitor sees the gap in
+       *          sequence numbers
+       */
+      bool Write(const char* message, size_t length)
+      {
+        if(Ring::Padded(length) > Ring::CAPACITY / 2 || !ReaderAttached())
+        {
+          Drop();
+          return false;
+        }
+        while(true)
+        {
+          uint32_t read = header->read.load();
+          if(TryWrite(message, length))
+            return true;
+          if(!ReaderAttached())
+          {
+            Drop();
+            return false;
+          }
+          header->writerSleeping.store(1);
+          // the reader may have made room before the flag was seen
+          if(header->read.load() == read)
+            futexWait(header->read, read, Ring::WAIT_MS);
+          header->writerSleeping.store(0);
+        }
+      }
+      bool Write(const std::string& message) { return Write(message.data(), message.size()); }
+      /** counts a message as sent without writing it */
+      void Drop()
+      {
+        sequence++;
+        header->dropped.fetch_add(1, std::memory_order_relaxed);
+      }
+      /** unmaps the ring and removes its name, an attached monitor keeps its mapping */
+      void Close()
+      {
+        if(header == nullptr)
+          return;
+        munmap(header, Ring::MappedSize());
+        shm_unlink(Ring::NAME);
+        header = nullptr;
+        data = nullptr;
+      }
+  };
+
+  /**
+   * @brief Consumer side of the ring
+   */
+  class RingReader
+  {
+    public:
+      enum Result {empty, message, reset};
+
+    private:
+      Ring::Header* header;
+      char* data;
+      uint64_t session;
+      uint64_t position;
+      /** sequence number of the next message, unknown until one is read after Open */
+      uint64_t expected;
+      bool synced;
+      ull lost;
+
+      /** lets a producer waiting for room check again */
+      void wakeWriter()
+      {
+        header->read.fetch_add(1);
+        if(header->writerSleeping.load())
+          futexWake(header->read);
+      }
+
+    public:
+      RingReader() : header(nullptr), data(nullptr), session(0), position(0), expected(0), synced(false), lost(0) {}
+      RingReader(const RingReader&) = delete;
+      RingReader& operator=(const RingReader&) = delete;
+      ~RingReader() { Close(); }
+      /**
+       * Attaches to the ring of a running shell
+       * @return  false if no shell has made one
+       */
+      bool Open()
+      {
+        int fd = shm_open(Ring::NAME, O_RDWR, 0600);
+        if(fd < 0)
+          return false;
+        struct stat st;
+        void* p = MAP_FAILED;
+        if(fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= Ring::MappedSize())
+          p = mmap(nullptr, Ring::MappedSize(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if(p == MAP_FAILED)
+          return false;
+        Ring::Header* h = static_cast<Ring::Header*>(p);
+        if(std::memcmp(h->magic, Ring::MAGIC, sizeof(Ring::MAGIC)) != 0 ||
+           h->version != Ring::VERSION || h->capacity != Ring::CAPACITY)
+        {
+          munmap(p, Ring::MappedSize());
+          return false;
+        }
+        header = h;
+        data = static_cast<char*>(p) + sizeof(Ring::Header);
+        session = header->session.load(std::memory_order_acquire);
+        // skip whatever is waiting, the shell sends everything again to a
+        // monitor that attaches
+        position = header->head.load(std::memory_order_acquire);
+        header->tail.store(position, std::memory_order_release);
+        synced = false;
+        header->reader.store(getpid());
+        header->attaches.fetch_add(1, std::memory_order_release);
+        wakeWriter();
+        return true;
+      }
+      bool IsOpen() const { return header != nullptr; }
+      /** returns the number of messages skipped because the ring overflowed */
+      ull Lost() const { return lost; }
+      /**
+       * Sleeps until the shell writes to the ring
+       * @param  timeoutMs  longest time to sleep in milliseconds
+       */
+      void Wait(int timeoutMs)
+      {
+        uint32_t written = header->written.load();
+        header->readerSleeping.store(1);
+        // a message written before the flag was seen does not wake us
+        if(header->head.load() == position && header->session.load() == session)
+          futexWait(header->written, written, timeoutMs);
+        header->readerSleeping.store(0);
+      }
+      /**
+       * Takes the next message
+       * @param  out  filled with the payload of the message
+       * @return  empty if there is none yet, reset if a new shell session
+       *          started and everything shown so far is stale
+       */
+      Result Read(std::string& out)
+      {
+        uint64_t current = header->session.load(std::memory_order_acquire);
+        if(current != session)
+        {
+          session = current;
+          position = 0;
+          expected = 0;
+          synced = true;
+          return reset;
+        }
+        while(true)
+        {
+          uint64_t head = header->head.load(std::memory_order_acquire);
+          if(position == head)
+            return empty;
+          if(head < position)
+          {
+            // a new session started between the check above and here
+            session = header->session.load(std::memory_order_acquire);
+            position = 0;
+            expected = 0;
+            synced = true;
+            return reset;
+          }
+          uint64_t offset = position & (Ring::CAPACITY - 1);
+          Ring::Record record;
+          std::memcpy(&record.length, data + offset, sizeof(record.length));
+          if(record.length == Ring::WRAP)
+          {
+            position += Ring::CAPACITY - offset;
+            continue;
+          }
+          std::memcpy(&record, data + offset, sizeof(record));
+          // messages dropped while the ring was full leave a gap
+          if(synced && record.sequence != expected)
+            lost += record.sequence - expected;
+          expected = record.sequence + 1;
+          synced = true;
+          out.assign(data + offset + sizeof(record), record.length);
+          position += Ring::Padded(record.length);
+          header->tail.store(position, std::memory_order_release);
+          wakeWriter();
+          return message;
+        }
+      }
+      /** detaches, the shell removes the ring when it exits */
+      void Close()
+      {
+        if(header == nullptr)
+          return;
+        int32_t pid = getpid();
+        header->reader.compare_exchange_strong(pid, 0);
+        munmap(header, Ring::MappedSize());
+        header = nullptr;
+        data = nullptr;
+      }
+  };
+
+  /**
+   * @brief Follows the bytes appended to the share file, the channel used
+   * when shared memory is not available
+   *
+   * Only bytes past the last read offset are read, so a poll costs the
+   * same however long the file is. Wait sleeps on inotify events of the
+   * file's directory, falling back to looking every POLL_MS if inotify
+   * is not available. A file that shrinks or is replaced by another one is
+   * reported as a reset and read again from the start.
+   */
+  class FileTail
+  {
+    public:
+      enum Result {empty, message, reset};
+
+    private:
+      static const size_t CHUNK = 64 * 1024;
+      /** milliseconds between looks at the file if inotify is not available */
+      static const int POLL_MS = 10;
+      std::string path;
+      int fd;
+      int notify;
+      ino_t inode;
+      off_t offset;
+
+      /**
+       * reopens the file if it was replaced and rewinds if it was cut short
+       * @return  if what was read so far no longer applies
+       */
+      bool check()
+      {
+        struct stat st;
+        if(stat(path.c_str(), &st) != 0)
+        {
+          // removed, wait for a new one to be made
+          if(fd >= 0)
+            close(fd);
+          fd = -1;
+          return false;
+        }
+        bool stale = false;
+        if(fd < 0 || st.st_ino != inode)
+        {
+          if(fd >= 0)
+          {
+            close(fd);
+            stale = true;
+          }
+          fd = open(path.c_str(), O_RDONLY);
+          inode = st.st_ino;
+          stale = stale || offset > 0;
+          offset = 0;
+        }
+        else if(st.st_size < offset)
+        {
+          offset = 0;
+          stale = true;
+        }
+        return stale;
+      }
+
+    public:
+      /**
+       * Starts following a file, it does not need to exist yet
+       * @param  file  path of the file
+       */
+      explicit FileTail(const std::string& file) : path(file), fd(-1), notify(-1), inode(0), offset(0)
+      {
+        notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if(notify >= 0)
+        {
+          size_t slash = path.rfind('/');
+          std::string directory = slash == std::string::npos ? "." : path.substr(0, slash);
+          if(inotify_add_watch(notify, directory.c_str(), IN_MODIFY | IN_CREATE | IN_DELETE |
+                               IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE) < 0)
+          {
+            close(notify);
+            notify = -1;
+          }
+        }
+      }
+      FileTail(const FileTail&) = delete;
+      FileTail& operator=(const FileTail&) = delete;
+      ~FileTail()
+      {
+        if(fd >= 0)
+          close(fd);
+        if(notify >= 0)
+          close(notify);
+      }
+      /** returns if changes wake Wait, otherwise it polls */
+      bool Notified() const { return notify >= 0; }
+      /**
+       * Sleeps until something in the file's directory changes
+       * @param  timeoutMs  longest time to sleep in milliseconds
+       */
+      void Wait(int timeoutMs)
+      {
+        if(notify < 0)
+        {
+          usleep(std::min(timeoutMs, POLL_MS) * 1000);
+          return;
+        }
+        struct pollfd waiter = {notify, POLLIN, 0};
+        if(poll(&waiter, 1, timeoutMs) > 0)
+        {
+          char events[4096];
+          while(read(notify, events, sizeof(events)) > 0)
+            ;
+        }
+      }
+      /**
+       * Takes the bytes appended since the last call, at most CHUNK
+       * @param  data  filled with the bytes, records may be cut anywhere
+       * @return  empty if there are none yet, reset if the file was cut
+       *          short or replaced and everything read so far is stale
+       */
+      Result Read(std::string& data)
+      {
+        if(check())
+          return reset;
+        if(fd < 0)
+          return empty;
+        data.resize(CHUNK);
+        ssize_t count = pread(fd, &data[0], CHUNK, offset);
+        data.resize(count > 0 ? count : 0);
+        if(count <= 0)
+          return empty;
+        offset += count;
+        return message;
+      }
+  };
+  const int FileTail::POLL_MS;
+}
+#endif
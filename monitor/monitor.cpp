@@ -9,6 +9,8 @@
 #include <chrono>
 #include <unistd.h>
 #include "taskMonitor.h"
+#include "channel.h"
+#include "protocol.h"
 
 // create a mutlitask thread that just checks for the quit command
 void static check(bool &stop, Display::TaskMonitor &monitor)
@@ -25,152 +27,122 @@ void static check(bool &stop, Display::TaskMonitor &monitor)
     else if (input.substr(0,6).compare("-size=") == 0)
     {
       std::cout << "size: " << stoi(input.substr(6)) << std::endl;
-      while(monitor.isPrinting());
       monitor.changeSize(stoi(input.substr(6)), -1);
     }
     else if (input.substr(0,7).compare("-hight=") == 0)
     {
       std::cout << "hight: " << stoi(input.substr(7)) << std::endl;
-      while(monitor.isPrinting());
       monitor.changeSize(-1, stoi(input.substr(7)));
     }
   }
 }
 
+// applies one update from the shell
+void static apply(const Shell::Update &update, bool &stop, Display::TaskMonitor &monitor)
+{
+  switch (update.type)
+  {
+    case Shell::Update::add:
+      // add the process to the to the task manager
+      monitor.addProcess(update.name, update.id, update.threadId, update.memory, update.time);
+      break;
+    case Shell::Update::change:
+      // updates the process
+      monitor.updateProcess(update.id, update.memory, update.time);
+      break;
+    case Shell::Update::kill:
+      // a time of 0 removes the process
+      monitor.updateProcess(update.id, 0, 0);
+      break;
+    case Shell::Update::clear:
+      monitor.clear();
+      break;
+    case Shell::Update::quit:
+      stop = true;
+      break;
+    default:
+      break;
+  }
+}
+
+// applies every complete update the decoder has.
+void static drain(Shell::UpdateDecoder &decoder, bool &stop, Display::TaskMonitor &monitor)
+{
+  Shell::Update update;
+  while (!stop && decoder.Next(update))
+  {
+    apply(update, stop, monitor);
+  }
+  if (!decoder.Error().empty())
+  {
+    monitor.setError(decoder.Error());
+  }
+}
+
 void static talker(bool &stop, Display::TaskMonitor &monitor)
 {
-  std::ifstream infile;
+  Shell::RingReader ring;
+  Shell::FileTail share("monitor/share.txt");
+  Shell::UpdateDecoder decoder;
   std::string input;
-  ull line = 0;
 
   while (!stop)
   {
-    usleep(100);
-    infile.open("monitor/share.txt",std::ifstream::binary);
-    for (unsigned int i = 0; i < line; i++)
+    // prefer the shared memory ring whenever a shell has made one
+    if (!ring.IsOpen() && ring.Open())
     {
-      if(!getline(infile, input))
-      {
-        line = 0;
-        monitor.clear();
-        infile.close();
-        infile.open("monitor/share.txt",std::ifstream::binary);
-      }
+      monitor.clear();
+      decoder.Reset();
     }
-    while (getline(infile, input))
+    if (ring.IsOpen())
     {
-      line++;
-      //std::cout << input << std::endl;
-
-      if (input[0] == 'n')
+      Shell::RingReader::Result result;
+      while (!stop && (result = ring.Read(input)) != Shell::RingReader::empty)
       {
-        // store the attributes of the new process.
-        std::string name = "";
-        int id = 0;
-        int threadId = 0;
-        int memory = 0;
-        ull time = 0;
-        // store the location that is being processed, and the current input.
-        int loc = 0;
-        int num = 0;
-        // store which input we are on.
-        while(input[loc + 1] != '|')
+        if (result == Shell::RingReader::reset)
         {
-          loc++;
-          if (input[loc] == '-')
-          {
-            num++;
-            continue;
-          }
-          if (num == 0)
-          {
-            id *= 10;
-            id += input[loc] - '0';
-          }
-          else if (num == 1)
-          {
-            name += input[loc];
-          }
-          else if (num == 2)
-          {
-            threadId *= 10;
-            threadId += input[loc] - '0';
-          }
-          else if (num == 3)
-          {
-            memory *= 10;
-            memory += input[loc] - '0';
-          }
-          else if (num == 4)
-          {
-            time *= 10;
-            time += input[loc] - '0';
-          }
-          else
-          {
-            break;
-          }
+          monitor.clear();
+          decoder.Reset();
         }
-        // add the process to the to the task manager
-        monitor.addProcess(name, id, threadId, memory, time);
-      }
-      else if (input[0] == 'u')
-      {
-        // store the attributes of the new process.
-        int id = 0;
-        int memory = 0;
-        ull time = 0;
-        // store the location that is being processed, and the current input.
-        int loc = 0;
-        int num = 0;
-        // store which input we are on.
-        while(input[loc + 1] != '|')
+        else
         {
-          loc++;
-          if (input[loc] == '-')
-          {
-            num++;
-            continue;
-          }
-          if (num == 0)
-          {
-            id *= 10;
-            id += input[loc] - '0';
-          }
-          else if (num == 1)
-          {
-            memory *= 10;
-            memory += input[loc] - '0';
-          }
-          else if (num == 2)
-          {
-            time *= 10;
-            time += input[loc] - '0';
-          }
-          else
-          {
-            break;
-          }
+          decoder.Feed(input);
+          drain(decoder, stop, monitor);
         }
-        // updates the process
-        monitor.updateProcess(id, memory, time);
       }
-      else if (input[0] == 'q')
+      monitor.setLost(ring.Lost());
+      // sleeps until the shell writes to the ring
+      if (!stop)
+        ring.Wait(100);
+      continue;
+    }
+
+    // otherwise follow what is written to the share file
+    Shell::FileTail::Result result;
+    while (!stop && (result = share.Read(input)) != Shell::FileTail::empty)
+    {
+      if (result == Shell::FileTail::reset)
       {
-        stop = true;
-        remove( "monitor/share.txt" );
-        return;
+        monitor.clear();
+        decoder.Reset();
       }
-      else if (input[0] == 'c')
+      else
       {
-        monitor.clear();
+        decoder.Feed(input);
+        drain(decoder, stop, monitor);
       }
     }
-    infile.close();
+    if (stop)
+    {
+      remove( "monitor/share.txt" );
+    }
+    else
+    {
+      // sleeps until the file changes, checking for a ring now and then
+      share.Wait(100);
+    }
   }
 
-  infile.close();
-
   return;
 }
 
@@ -0,0 +1,257 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+#include <string>
+#include <cstring>
+#ifndef ull
+#define ull unsigned long long
+#endif
+
+namespace Shell
+{
+  /**
+   * One message from the shell to the task monitor
+   */
+  struct Update
+  {
+    enum Type {hello, add, change, kill, clear, quit};
+    Type type;
+    /** protocol version for hello, task id otherwise */
+    ull id;
+    ull threadId;
+    ull memory;
+    ull time;
+    std::string name;
+  };
+
+  /**
+   * @brief Encodes Updates as compact binary records
+   *
+   * A record is its body length as a varint followed by the body: the
+   * type byte and the varint fields of that type. add carries id, thread,
+   * memory, time and the name bytes, change carries id, memory and time,
+   * kill only the id. Every stream starts with a hello record holding
+   * VERSION, and another hello marks each point a new reader can start
+   * from. Readers skip the bodies of types they don't know, so new
+   * types can be added without a new version.
+   */
+  class UpdateEncoder
+  {
+    public:
+      static const ull VERSION = 1;
+
+    private:
+      std::string& out;
+      /** start of the body of the record being written */
+      size_t body;
+
+      void putVarint(ull value)
+      {
+        while(value >= 0x80)
+        {
+          out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+          value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+      }
+      void begin(Update::Type type)
+      {
+        // the length is patched in by end, one byte covers most records
+        out.push_back(0);
+        body = out.size();
+        out.push_back(static_cast<char>(type));
+      }
+      void end()
+      {
+        size_t length = out.size() - body;
+        if(length < 0x80)
+        {
+          out[body - 1] = static_cast<char>(length);
+          return;
+        }
+        std::string tail = out.substr(body);
+        out.resize(body - 1);
+        putVarint(length);
+        out += tail;
+      }
+
+    public:
+      /**
+       * @param  buffer  records are appended here, clearing it between
+       *                 batches lets its memory be reused
+       */
+      explicit UpdateEncoder(std::string& buffer) : out(buffer), body(0) {}
+      void Hello()
+      {
+        begin(Update::hello);
+        putVarint(VERSION);
+        end();
+      }
+      void Add(ull id, const std::string& name, ull threadId, ull memory, ull time)
+      {
+        begin(Update::add);
+        putVarint(id);
+        putVarint(threadId);
+        putVarint(memory);
+        putVarint(time);
+        out.append(name);
+        end();
+      }
+      void Change(ull id, ull memory, ull time)
+      {
+        begin(Update::change);
+        putVarint(id);
+        putVarint(memory);
+        putVarint(time);
+        end();
+      }
+      void Kill(ull id)
+      {
+        begin(Update::kill);
+        putVarint(id);
+        end();
+      }
+      void Clear()
+      {
+        begin(Update::clear);
+        end();
+      }
+      void Quit()
+      {
+        begin(Update::quit);
+        end();
+      }
+  };
+  const ull UpdateEncoder::VERSION;
+
+  /**
+   * @brief Decodes the records made by UpdateEncoder
+   *
+   * Bytes can be fed in any pieces, a record cut in two is kept until the
+   * rest arrives. Records before the first hello are skipped, so a reader
+   * can join a stream at any record boundary and pick up at the next
+   * hello. A hello of an unknown version, or a record that does not
+   * parse, stops the decoder until Reset.
+   */
+  class UpdateDecoder
+  {
+    private:
+      std::string buffer;
+      size_t start;
+      bool started;
+      std::string error;
+
+      static bool getVarint(const char*& p, const char* end, ull& value)
+      {
+        value = 0;
+        for(unsigned int shift = 0; shift < 64 && p < end; shift += 7)
+        {
+          unsigned char byte = *p++;
+          value |= static_cast<ull>(byte & 0x7f) << shift;
+          if((byte & 0x80) == 0)
+            return true;
+        }
+        return false;
+      }
+
+    public:
+      /** largest record body accepted */
+      static const ull MAX_RECORD = 1 << 20;
+
+      UpdateDecoder() : start(0), started(false) {}
+      /** adds received bytes */
+      void Feed(const char* data, size_t size)
+      {
+        if(start > 0 && start * 2 >= buffer.size())
+        {
+          buffer.erase(0, start);
+          start = 0;
+        }
+        buffer.append(data, size);
+      }
+      void Feed(const std::string& data) { Feed(data.data(), data.size()); }
+      /** drops everything buffered and waits for a new stream */
+      void Reset()
+      {
+        buffer.clear();
+        start = 0;
+        started = false;
+        error.clear();
+      }
+      /** returns why decoding stopped, empty if it did not */
+      const std::string& Error() const { return error; }
+      /**
+       * Takes the next complete record
+       * @return  false if there is none yet or decoding stopped
+       */
+      bool Next(Update& update)
+      {
+        while(error.empty())
+        {
+          const char* p = buffer.data() + start;
+          const char* end = buffer.data() + buffer.size();
+          ull length;
+          if(!getVarint(p, end, length))
+          {
+            if(end - p >= 10)
+              error = "bad record length";
+            return false;
+          }
+          if(length == 0 || length > MAX_RECORD)
+          {
+            error = "bad record length";
+            return false;
+          }
+          if(static_cast<ull>(end - p) < length)
+            return false;
+          const char* bodyEnd = p + length;
+          start = bodyEnd - buffer.data();
+          unsigned char type = *p++;
+          // joined in the middle of a stream, wait for the next hello
+          if(!started && type != Update::hello)
+            continue;
+          if(type > Update::quit)
+            continue;
+          update.type = static_cast<Update::Type>(type);
+          update.id = update.threadId = update.memory = update.time = 0;
+          update.name.clear();
+          bool ok = true;
+          switch(update.type)
+          {
+            case Update::hello:
+              ok = getVarint(p, bodyEnd, update.id);
+              if(ok && update.id != UpdateEncoder::VERSION)
+              {
+                error = "unsupported protocol version " + std::to_string(update.id);
+                return false;
+              }
+              started = true;
+              break;
+            case Update::add:
+              ok = getVarint(p, bodyEnd, update.id) && getVarint(p, bodyEnd, update.threadId) &&
+                   getVarint(p, bodyEnd, update.memory) && getVarint(p, bodyEnd, update.time);
+              if(ok)
+                update.name.assign(p, bodyEnd);
+              break;
+            case Update::change:
+              ok = getVarint(p, bodyEnd, update.id) && getVarint(p, bodyEnd, update.memory) &&
+                   getVarint(p, bodyEnd, update.time);
+              break;
+            case Update::kill:
+              ok = getVarint(p, bodyEnd, update.id);
+              break;
+            default:
+              break;
+          }
+          if(!ok)
+          {
+            error = "record is cut short";
+            return false;
+          }
+          return true;
+        }
+        return false;
+      }
+  };
+  const ull UpdateDecoder::MAX_RECORD;
+}
+#endif
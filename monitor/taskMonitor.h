@@ -1,4 +1,6 @@
 #include <vector>
+#include <map>
+#include <mutex>
 #include <iostream>
 #include <limits>
 #include <sstream>
@@ -34,10 +36,16 @@ namespace Display
   {
     // Private vars
     private:
-      // stores the running process that are being displated.
-      std::vector<process> running;
-      // tracks weither or not the process is printing
-      bool printing;
+      // stores the running process that are being displated, by id so
+      // adding and removing one stays cheap with many processes.
+      std::map<int, process> running;
+      // guards everything print reads, taken by the talker's updates
+      // and the size changes while print builds the screen.
+      std::mutex lock;
+      // number of updates from the shell that were lost to a full channel.
+      ull lost;
+      // why updates from the shell could not be read, empty if they can.
+      std::string error;
       // track the machine info.
       unsigned int memory;
       // int cpu;
@@ -71,7 +79,7 @@ namespace Display
       TaskMonitor()
       {
         // set all the default values
-        printing = false;
+        lost = 0;
         memory = 0;
         // cpu = 0;
         screenSize = MINSIZE;
@@ -91,6 +99,7 @@ namespace Display
       TaskMonitor(unsigned int mem, unsigned int size, unsigned int hight)
       {
         // set the memory and cpu
+        lost = 0;
         memory = mem;
         // cpu = cp;
         // validate the size and hight. Set them with the validated results.
@@ -148,13 +157,13 @@ namespace Display
       // prints out the task manager.
       void print()
       {
-        printing = true;
+        std::unique_lock<std::mutex> guard(lock);
         // count the used cpu and memory.
         // int usedCPU = 0;
         unsigned int usedMem = 0;
         for (auto it = std::begin(running); it!=std::end(running); ++it)
         {
-          usedMem += (*it).memory;
+          usedMem += it->second.memory;
           // usedCPU += (*it).cpu;
         }
         // helper int for printing buffering.
@@ -175,6 +184,8 @@ namespace Display
         empty.name = "";
         empty.threadId = 0;
         empty.time = 0;
+        // the next process to display.
+        auto shown = running.begin();
         // iterate over the screen hight.
         for (unsigned int i = 0; i < screenHight; i++)
         {
@@ -299,9 +310,10 @@ namespace Display
           {
             // decides the process to display, aka a empty if there is none.
             process display;
-            if (i <= running.size())
+            if (shown != running.end())
             {
-              display = running[i - 1];
+              display = shown->second;
+              ++shown;
             }
             else
             {
@@ -429,7 +441,16 @@ namespace Display
           }
           out << "|";
         }
-        printing = false;
+        // warn that the list may be missing processes.
+        if (lost > 0)
+        {
+          out << "\n" << lost << " updates lost";
+        }
+        if (!error.empty())
+        {
+          out << "\nbad updates from the shell: " << error;
+        }
+        guard.unlock();
         std::cout << out.str() << std::endl;
 
         return;
@@ -442,14 +463,12 @@ namespace Display
           return;
         }
 
-        for (auto it = std::begin(running); it!=std::end(running); ++it)
+        std::lock_guard<std::mutex> guard(lock);
+        if (running.find(id) != running.end())
         {
-          if ((*it).id == id)
-          {
-            std::cout << "process already exists: " << id << std::endl;
+          std::cout << "process already exists: " << id << std::endl;
 
-            return;
-          }
+          return;
         }
 
         process newProcess;
@@ -461,31 +480,26 @@ namespace Display
         newProcess.time = time;
         // std::cout << "ID: " << id << "-Name: " << name << "-Mem: " << memory
         //           << "-TID: " << threadId << "-Time: " << time << std::endl;
-        running.push_back(newProcess);
-        std::sort(running.begin(), running.end(), compareProcess);
+        running.emplace(id, newProcess);
 
         return;
       }
 
       void updateProcess(int id, unsigned int memory, ull time)
       {
-        while (printing)
-        {
-          continue;
-        }
-        for (auto it = std::begin(running); it!=std::end(running); ++it)
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = running.find(id);
+        if (it != running.end())
         {
-          if ((*it).id == id)
+          if (time <= 0)
           {
-            if (time <= 0)
-            {
-              running.erase(it);
-              break;
-            }
-            (*it).memory = memory;
-            // (*it).cpu = cpu;
-            (*it).time = time;
-            break;
+            running.erase(it);
+          }
+          else
+          {
+            it->second.memory = memory;
+            // it->second.cpu = cpu;
+            it->second.time = time;
           }
         }
 
@@ -494,6 +508,7 @@ namespace Display
 
       void changeSize(int width, int hight)
       {
+        std::lock_guard<std::mutex> guard(lock);
         if (width > 0 && static_cast<unsigned int>(width) < MINSIZE)
         {
           std::cout << "WARNING! Minimum size is " << MINSIZE << ". Setting to minimum" << std::endl;
@@ -546,13 +561,28 @@ namespace Display
 
       void setComp(unsigned int mem)
       {
+        std::lock_guard<std::mutex> guard(lock);
         // cpu = cp;
         memory = mem;
       }
 
       void clear()
       {
+        std::lock_guard<std::mutex> guard(lock);
         running.clear();
+        error.clear();
+      }
+
+      void setLost(ull count)
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        lost = count;
+      }
+
+      void setError(const std::string &message)
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        error = message;
       }
 
       static bool compareProcess(process a, process b)
@@ -560,7 +590,6 @@ namespace Display
         return a.id < b.id;
       }
 
-      bool isPrinting() { return printing; }
     // Private functions
     private:
   };
@@ -0,0 +1,122 @@
+#ifndef POOL_H
+#define POOL_H
+#include <vector>
+#include <string>
+#include <cstring>
+#ifndef ull
+#define ull unsigned long long
+#endif
+
+namespace Shell
+{
+  /**
+   * @brief Chunked bump allocator for strings that are released together
+   *
+   * Strings are copied back to back into large chunks so storing many
+   * small names costs one heap allocation per chunk instead of one per
+   * name. Nothing is freed on its own: Release drops every chunk at once.
+   */
+  class Arena
+  {
+    public:
+      /**
+       * counters of an arena
+       */
+      struct Stats
+      {
+        /** number of chunks currently held */
+        ull chunks;
+        /** bytes held by the chunks */
+        ull reserved;
+        /** bytes handed out since the last release */
+        ull used;
+        /** number of chunk allocations over the life of the arena */
+        ull allocations;
+      };
+
+    private:
+      /**
+       * size of a regular chunk, longer strings get a chunk of their own
+       */
+      static const size_t CHUNK_SIZE = 64 * 1024;
+      std::vector<char*> chunks;
+      /**
+       * bytes used of the last chunk and its size
+       */
+      size_t offset;
+      size_t capacity;
+      ull reserved;
+      ull used;
+      ull allocations;
+
+      void grow(size_t size)
+      {
+        capacity = size > CHUNK_SIZE ? size : CHUNK_SIZE;
+        chunks.push_back(new char[capacity]);
+        offset = 0;
+        reserved += capacity;
+        allocations++;
+      }
+
+    public:
+      Arena() : offset(0), capacity(0), reserved(0), used(0), allocations(0) {}
+      Arena(const Arena&) = delete;
+      Arena& operator=(const Arena&) = delete;
+      ~Arena() { Release(); }
+
+      /**
+       * Copies a string into the arena
+       * @param  str  characters to copy
+       * @param  length  number of characters
+       * @return  the copy, valid until Release, not NUL terminated
+       */
+      const char* Copy(const char* str, size_t length)
+      {
+        if(length == 0)
+          return "";
+        if(chunks.empty() || capacity - offset < length)
+          grow(length);
+        char* copy = chunks.back() + offset;
+        std::memcpy(copy, str, length);
+        offset += length;
+        used += length;
+        return copy;
+      }
+      /**
+       * frees every chunk, all copies become invalid
+       */
+      void Release()
+      {
+        for(char* chunk : chunks)
+          delete[] chunk;
+        chunks.clear();
+        offset = 0;
+        capacity = 0;
+        reserved = 0;
+        used = 0;
+      }
+      /**
+       * swaps contents with another arena, counters included
+       */
+      void Swap(Arena& other)
+      {
+        chunks.swap(other.chunks);
+        std::swap(offset, other.offset);
+        std::swap(capacity, other.capacity);
+        std::swap(reserved, other.reserved);
+        std::swap(used, other.used);
+        std::swap(allocations, other.allocations);
+      }
+      /** returns a snapshot of the counters */
+      Stats GetStats() const
+      {
+        Stats s;
+        s.chunks = chunks.size();
+        s.reserved = reserved;
+        s.used = used;
+        s.allocations = allocations;
+        return s;
+      }
+  };
+}
+#endif
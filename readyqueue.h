@@ -0,0 +1,193 @@
+#ifndef READYQUEUE_H
+#define READYQUEUE_H
+#include <vector>
+#include <algorithm>
+#include <list>
+#ifndef ull
+#define ull unsigned long long
+#endif
+
+namespace Shell
+{
+  /**
+   * @brief Indexed binary min-heap of task handles used as a ready queue
+   *
+   * Tasks are ordered by a key (e.g. process time) and, for equal keys, by
+   * the order they were pushed in so ties keep arrival order. The queued
+   * values are TaskTable handles, the heap position of each is kept in a
+   * flat column indexed by the handle's table row, so any task can be
+   * removed in O(log n) without a hash node per push.
+   */
+  class ReadyHeap
+  {
+    private:
+      struct Entry
+      {
+        ull key;
+        ull seq;
+        ull id;
+      };
+      /**
+       * heap ordered array of the entries
+       */
+      std::vector<Entry> heap;
+      /**
+       * position inside of heap of the task in each table row, NPOS if
+       * the row is not queued
+       */
+      std::vector<size_t> positions;
+      /**
+       * running counter used to break ties in arrival order
+       */
+      ull sequence;
+
+      static const size_t NPOS = ~static_cast<size_t>(0);
+
+      /** table row of a handle, see TaskTable::Handle */
+      static size_t row(ull id) { return static_cast<size_t>(id & 0xffffffffULL); }
+      static bool Less(const Entry& a, const Entry& b)
+      {
+        return a.key < b.key || (a.key == b.key && a.seq < b.seq);
+      }
+      void Place(size_t i, const Entry& e)
+      {
+        heap[i] = e;
+        positions[row(e.id)] = i;
+      }
+      void SiftUp(size_t i)
+      {
+        Entry e = heap[i];
+        while(i > 0)
+        {
+          size_t parent = (i - 1) / 2;
+          if(!Less(e, heap[parent]))
+            break;
+          Place(i, heap[parent]);
+          i = parent;
+        }
+        Place(i, e);
+      }
+      void SiftDown(size_t i)
+      {
+        Entry e = heap[i];
+        size_t size = heap.size();
+        while(true)
+        {
+          size_t child = 2 * i + 1;
+          if(child >= size)
+            break;
+          if(child + 1 < size && Less(heap[child + 1], heap[child]))
+            child++;
+          if(!Less(heap[child], e))
+            break;
+          Place(i, heap[child]);
+          i = child;
+        }
+        Place(i, e);
+      }
+      /**
+       * removes the entry at position i keeping the heap valid
+       */
+      void RemoveAt(size_t i)
+      {
+        positions[row(heap[i].id)] = NPOS;
+        Entry last = heap.back();
+        heap.pop_back();
+        if(i < heap.size())
+        {
+          Place(i, last);
+          if(i > 0 && Less(last, heap[(i - 1) / 2]))
+            SiftUp(i);
+          else
+            SiftDown(i);
+        }
+      }
+
+    public:
+      ReadyHeap() : sequence(0) {}
+      /** returns the number of queued ids */
+      size_t Size() const { return heap.size(); }
+      /** returns if nothing is queued */
+      bool Empty() const { return heap.empty(); }
+      /** returns if the id is queued */
+      bool Contains(ull id) const
+      {
+        // the row may hold a newer task, the handle's generation tells them apart
+        size_t r = row(id);
+        return r < positions.size() && positions[r] != NPOS && heap[positions[r]].id == id;
+      }
+      /** returns the id with the smallest key, heap must not be empty */
+      ull Top() const { return heap.front().id; }
+      /** returns the smallest key, heap must not be empty */
+      ull TopKey() const { return heap.front().key; }
+      /**
+       * Queues an id
+       * @param  id  handle of the task, its row must not be queued under another handle
+       * @param  key  value the heap is ordered by
+       * @return  false if the id was already queued
+       */
+      bool Push(ull id, ull key)
+      {
+        if(Contains(id))
+          return false;
+        if(row(id) >= positions.size())
+          positions.resize(std::max(row(id) + 1, positions.size() * 2), NPOS);
+        Entry e;
+        e.key = key;
+        e.seq = sequence++;
+        e.id = id;
+        heap.push_back(e);
+        SiftUp(heap.size() - 1);
+        return true;
+      }
+      /**
+       * Removes and returns the id with the smallest key
+       * heap must not be empty
+       */
+      ull Pop()
+      {
+        ull id = heap.front().id;
+        RemoveAt(0);
+        return id;
+      }
+      /**
+       * Removes and returns the last id in heap order. It is a leaf so it
+       * is never the next to run unless it is the only id. heap must not
+       * be empty
+       */
+      ull PopBack()
+      {
+        ull id = heap.back().id;
+        RemoveAt(heap.size() - 1);
+        return id;
+      }
+      /**
+       * Removes an id from anywhere in the heap
+       * @return  true if it was queued
+       */
+      bool Remove(ull id)
+      {
+        if(!Contains(id))
+          return false;
+        RemoveAt(positions[row(id)]);
+        return true;
+      }
+      /** returns the queued ids in heap order (not sorted) */
+      std::list<ull> IDs() const
+      {
+        std::list<ull> ids;
+        for(const Entry& e : heap)
+          ids.push_back(e.id);
+        return ids;
+      }
+      /** removes every queued id */
+      void Clear()
+      {
+        for(const Entry& e : heap)
+          positions[row(e.id)] = NPOS;
+        heap.clear();
+      }
+  };
+  const size_t ReadyHeap::NPOS;
+}
+#endif
@@ -1,6 +1,8 @@
 #ifndef TASK_H
 #define TASK_H
 #include <list>
+#include <string>
+#include <atomic>
 #ifndef ull
 #define ull unsigned long long
 #endif
@@ -17,13 +19,21 @@ namespace Shell
        * Status enum: represents the current status of the task
        */
       enum Status {done, running, waiting, error};
+      /**
+       * first run time of a process that has not run yet
+       */
+      static const ull NOT_RUN = ~0ULL;
+      /**
+       * number of IDs a host thread takes from the counter at a time
+       */
+      static const ull ID_BLOCK = 1024;
 
     private:
       std::string name;
       /**
-       * running counter of ID
+       * start of the next block of IDs not handed to a host thread yet
        */
-      static ull ID_COUNTER;
+      static std::atomic<ull> ID_COUNTER;
       /**
        * Unqiue ID of this process.
        */
@@ -44,6 +54,40 @@ namespace Shell
        * Status of this Process.
        */
       Status status;
+      /**
+       * Priority level of this process, 0 is the highest.
+       */
+      unsigned int level;
+      /**
+       * Simulated time this process was added to a thread.
+       */
+      ull arrivalTime;
+      /**
+       * Simulated time this process was first given the cpu.
+       */
+      ull firstRunTime;
+      /**
+       * Simulated time this process finished running.
+       */
+      ull completionTime;
+
+      /**
+       * Takes the next ID of this host thread's block, only touching the
+       * shared counter once per ID_BLOCK IDs so producers creating tasks
+       * at the same time don't contend. IDs are unique across the run but
+       * only increase within one host thread.
+       */
+      static ull nextID()
+      {
+        static thread_local ull next = 0;
+        static thread_local ull end = 0;
+        if(next == end)
+        {
+          next = ID_COUNTER.fetch_add(ID_BLOCK, std::memory_order_relaxed);
+          end = next + ID_BLOCK;
+        }
+        return next++;
+      }
 
     public:
       /**
@@ -72,6 +116,34 @@ namespace Shell
        * @return  The current status.
        */
       Status Status() const { return status; }
+      /**
+       * Get the simulated time this process arrived on its thread.
+       * @return  The arrival time.
+       */
+      ull ArrivalTime() const { return arrivalTime; }
+      /**
+       * Get the simulated time this process first ran.
+       * @return  The first run time, NOT_RUN if it has not run yet.
+       */
+      ull FirstRunTime() const { return firstRunTime; }
+      /**
+       * Get the simulated time this process finished.
+       * @return  The completion time, only valid once done.
+       */
+      ull CompletionTime() const { return completionTime; }
+      /**
+       * Get the priority level of this process, used by multilevel threads.
+       * @return  The level, 0 is the highest priority.
+       */
+      unsigned int Level() const { return level; }
+      /** Sets the priority level of this process */
+      void SetLevel(const unsigned int l) { level = l; }
+      /** Sets the simulated time this process arrived at */
+      void SetArrivalTime(const ull time) { arrivalTime = time; }
+      /** Sets the simulated time this process first ran at */
+      void SetFirstRunTime(const ull time) { firstRunTime = time; }
+      /** Sets the simulated time this process finished at */
+      void SetCompletionTime(const ull time) { completionTime = time; }
 
       /**
        * @brief  Blocks the current running process
@@ -98,12 +170,13 @@ namespace Shell
           status = running;
         if(status == running)
         {
-          timeRemaining -= time;
-          if(timeRemaining <= 0)
+          if(time >= timeRemaining)
           {
             timeRemaining = 0;
             status = done;
           }
+          else
+            timeRemaining -= time;
         }
       }
       /**
@@ -118,30 +191,39 @@ namespace Shell
       Task(std::string pName, unsigned long long pTime, unsigned int memUsage)
       {
         name = pName;
-        id = ID_COUNTER++;
+        id = nextID();
         processTime = pTime;
         memoryUsage = memUsage;
         timeRemaining = processTime;
         status = waiting;
+        level = 0;
+        arrivalTime = 0;
+        firstRunTime = NOT_RUN;
+        completionTime = 0;
       }
 
-      Task(const Task& t)
-      {
-        id = ID_COUNTER++;
-        name = t.name;
-        processTime = t.processTime;
-        memoryUsage = t.memoryUsage;
-        timeRemaining = processTime;
-        status = waiting;
-      }
+      /**
+       * copies every field, including the ID
+       */
+      Task(const Task& t) = default;
+      Task& operator=(const Task& t) = default;
 
       Task(const Task* t) : Task(*t) {}
 
+      /**
+       * @brief  Makes a new process from this one used as a template
+       * @return  a waiting process with the same name, process time and
+       *          memory usage and its own unique id
+       */
+      Task Spawn() const { return Task(name, processTime, memoryUsage); }
+
   };
   /**
    * initialization of static counter
    */
-  unsigned long long Task::ID_COUNTER = 0;
+  std::atomic<ull> Task::ID_COUNTER(0);
+  const ull Task::NOT_RUN;
+  const ull Task::ID_BLOCK;
 
 }
 
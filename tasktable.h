@@ -0,0 +1,449 @@
+#ifndef TASKTABLE_H
+#define TASKTABLE_H
+#include <vector>
+#include <string>
+#include <algorithm>
+#ifndef ull
+#define ull unsigned long long
+#endif
+#include "task.h"
+#include "pool.h"
+
+namespace Shell
+{
+  /**
+   * Copy of everything a thread knows about one of its tasks
+   */
+  struct TaskRecord
+  {
+    ull id;
+    std::string name;
+    ull processTime;
+    ull timeRemaining;
+    ull memoryUsage;
+    enum Task::Status status;
+    unsigned int level;
+    ull arrivalTime;
+    ull firstRunTime;
+    ull completionTime;
+  };
+
+  /**
+   * @brief Index addressed table holding the tasks of a thread
+   *
+   * Each field is its own contiguous column (structure of arrays) so a
+   * scheduling step only touches the few fields it needs. Rows are reached
+   * through handles made of the row index and a generation that changes
+   * whenever the row is reused, so a stale handle is never mistaken for
+   * the task that now lives in the row. Names are kept in an Arena and ids
+   * in a flat open addressed index, so adding a task allocates nothing once
+   * the columns have grown.
+   */
+  class TaskTable
+  {
+    public:
+      typedef unsigned long long Handle;
+      /**
+       * handle that refers to no task
+       */
+      static const Handle NONE = ~0ULL;
+      /**
+       * allocation counters of a table
+       */
+      struct AllocStats
+      {
+        /** rows in use and rows waiting to be reused */
+        ull rows;
+        ull freeRows;
+        /** heap allocations made by growing columns, the index or the name arena */
+        ull allocations;
+        /** name arena chunks and their bytes held and in use */
+        ull arenaChunks;
+        ull arenaReserved;
+        ull arenaUsed;
+        /** number of times the name arena was rebuilt to drop dead names */
+        ull compactions;
+      };
+
+    private:
+      /**
+       * marks an empty slot of the id index
+       */
+      static const unsigned int EMPTY = ~0U;
+      /**
+       * smallest number of dead name bytes worth compacting the arena for
+       */
+      static const ull COMPACT_BYTES = 64 * 1024;
+      // hot columns, read on every scheduling step
+      std::vector<ull> timeRemaining;
+      std::vector<ull> processTime;
+      std::vector<ull> memoryUsage;
+      std::vector<unsigned char> status;
+      std::vector<unsigned char> level;
+      // cold columns
+      std::vector<ull> ids;
+      std::vector<ull> arrivalTime;
+      std::vector<ull> firstRunTime;
+      std::vector<ull> completionTime;
+      std::vector<const char*> names;
+      std::vector<unsigned int> nameLengths;
+      /**
+       * bumped every time a row is freed and again when it is reused,
+       * so it is even while the row holds a task
+       */
+      std::vector<unsigned int> generations;
+      /**
+       * rows that are free to be reused
+       */
+      std::vector<unsigned int> freeRows;
+      /**
+       * open addressed index from task id to row, slots hold a row or
+       * EMPTY and the size is always a power of two
+       */
+      std::vector<unsigned int> slots;
+      size_t count;
+      /**
+       * storage of the names and bytes of it no longer used by a row
+       */
+      Arena arena;
+      ull deadBytes;
+      ull allocations;
+      ull compactions;
+
+      static unsigned int row(Handle h) { return static_cast<unsigned int>(h & 0xffffffffULL); }
+      Handle handle(unsigned int r) const { return (static_cast<ull>(generations[r]) << 32) | r; }
+      size_t home(ull id) const { return (id * 0x9E3779B97F4A7C15ULL >> 17) & (slots.size() - 1); }
+      /**
+       * slot holding the id or the empty slot it would go in
+       */
+      size_t probe(ull id) const
+      {
+        size_t i = home(id);
+        while(slots[i] != EMPTY && ids[slots[i]] != id)
+          i = (i + 1) & (slots.size() - 1);
+        return i;
+      }
+      /**
+       * at least doubles the index so it can hold entries while at most
+       * half full
+       */
+      void growIndex(size_t entries)
+      {
+        std::vector<unsigned int> old;
+        old.swap(slots);
+        size_t size = old.empty() ? 16 : old.size() * 2;
+        while(size < entries * 2)
+          size *= 2;
+        slots.assign(size, EMPTY);
+        allocations++;
+        for(unsigned int r : old)
+          if(r != EMPTY)
+            slots[probe(ids[r])] = r;
+      }
+      /**
+       * empties a slot, moving later entries of the probe run back so
+       * lookups never stop early
+       */
+      void unindex(size_t i)
+      {
+        size_t mask = slots.size() - 1;
+        size_t next = (i + 1) & mask;
+        while(slots[next] != EMPTY)
+        {
+          size_t want = home(ids[slots[next]]);
+          // move it if its home is not in the cyclic range (i, next]
+          if((next > i && (want <= i || want > next)) || (next < i && want <= i && want > next))
+          {
+            slots[i] = slots[next];
+            i = next;
+          }
+          next = (next + 1) & mask;
+        }
+        slots[i] = EMPTY;
+        count--;
+      }
+      /**
+       * copies the names still in use into a fresh arena and frees the old one
+       */
+      void compact()
+      {
+        Arena fresh;
+        for(unsigned int r = 0; r < ids.size(); r++)
+          if(generations[r] % 2 == 0)
+            names[r] = fresh.Copy(names[r], nameLengths[r]);
+        allocations += arena.GetStats().allocations;
+        arena.Swap(fresh);
+        deadBytes = 0;
+        compactions++;
+      }
+      /**
+       * appends an empty row, counting the allocation if a column grows
+       */
+      void addRow()
+      {
+        if(ids.size() == ids.capacity())
+          allocations++;
+        timeRemaining.push_back(0);
+        processTime.push_back(0);
+        memoryUsage.push_back(0);
+        status.push_back(0);
+        level.push_back(0);
+        ids.push_back(0);
+        arrivalTime.push_back(0);
+        firstRunTime.push_back(0);
+        completionTime.push_back(0);
+        names.push_back("");
+        nameLengths.push_back(0);
+        generations.push_back(0);
+      }
+
+    public:
+      TaskTable() : count(0), deadBytes(0), allocations(0), compactions(0) {}
+      TaskTable(const TaskTable&) = delete;
+      TaskTable& operator=(const TaskTable&) = delete;
+      /** returns the number of tasks in the table */
+      size_t Size() const { return count; }
+      /** returns the number of rows, used or free */
+      size_t Capacity() const { return ids.size(); }
+      /** returns if the handle refers to a task in the table */
+      bool Valid(Handle h) const
+      {
+        return h != NONE && row(h) < ids.size() && generations[row(h)] == (h >> 32) && generations[row(h)] % 2 == 0;
+      }
+      /**
+       * Finds the task with an id
+       * @return  its handle or NONE
+       */
+      Handle Find(ull id) const
+      {
+        if(count == 0)
+          return NONE;
+        size_t i = probe(id);
+        return slots[i] == EMPTY ? NONE : handle(slots[i]);
+      }
+      /**
+       * Makes room for more tasks so inserting them grows the columns
+       * and the index at most once
+       * @param  more  number of tasks about to be inserted
+       */
+      void Reserve(size_t more)
+      {
+        size_t rowsNeeded = ids.size() + (more > freeRows.size() ? more - freeRows.size() : 0);
+        if(rowsNeeded > ids.capacity())
+        {
+          // grow geometrically so a stream of batches stays linear
+          rowsNeeded = std::max(rowsNeeded, ids.capacity() * 2);
+          timeRemaining.reserve(rowsNeeded);
+          processTime.reserve(rowsNeeded);
+          memoryUsage.reserve(rowsNeeded);
+          status.reserve(rowsNeeded);
+          level.reserve(rowsNeeded);
+          ids.reserve(rowsNeeded);
+          arrivalTime.reserve(rowsNeeded);
+          firstRunTime.reserve(rowsNeeded);
+          completionTime.reserve(rowsNeeded);
+          names.reserve(rowsNeeded);
+          nameLengths.reserve(rowsNeeded);
+          generations.reserve(rowsNeeded);
+          allocations++;
+        }
+        if((count + more) * 2 > slots.size())
+          growIndex(count + more);
+      }
+      /**
+       * Copies a task into the table
+       * @return  handle of the new row, NONE if the id is already in the table
+       */
+      Handle Insert(const TaskRecord& task)
+      {
+        if(Find(task.id) != NONE)
+          return NONE;
+        if((count + 1) * 2 > slots.size())
+          growIndex(count + 1);
+        unsigned int r;
+        if(freeRows.empty())
+        {
+          r = ids.size();
+          addRow();
+        }
+        else
+        {
+          r = freeRows.back();
+          freeRows.pop_back();
+          generations[r]++;
+        }
+        timeRemaining[r] = task.timeRemaining;
+        processTime[r] = task.processTime;
+        memoryUsage[r] = task.memoryUsage;
+        status[r] = task.status;
+        level[r] = task.level;
+        ids[r] = task.id;
+        arrivalTime[r] = task.arrivalTime;
+        firstRunTime[r] = task.firstRunTime;
+        completionTime[r] = task.completionTime;
+        names[r] = arena.Copy(task.name.data(), task.name.size());
+        nameLengths[r] = task.name.size();
+        slots[probe(task.id)] = r;
+        count++;
+        return handle(r);
+      }
+      /**
+       * Copies a task into the table
+       * @return  handle of the new row, NONE if the id is already in the table
+       */
+      Handle Insert(const Task& task) { return Insert(Record(task)); }
+      /** returns a record with every field of a task */
+      static TaskRecord Record(const Task& task)
+      {
+        TaskRecord record;
+        record.id = task.ID();
+        record.name = task.Name();
+        record.processTime = task.ProcessTime();
+        record.timeRemaining = task.TimeRemaining();
+        record.memoryUsage = task.MemoryUsage();
+        record.status = task.Status();
+        record.level = task.Level();
+        record.arrivalTime = task.ArrivalTime();
+        record.firstRunTime = task.FirstRunTime();
+        record.completionTime = task.CompletionTime();
+        return record;
+      }
+      /**
+       * Removes a task, its handle becomes invalid
+       */
+      void Erase(Handle h)
+      {
+        unsigned int r = row(h);
+        unindex(probe(ids[r]));
+        deadBytes += nameLengths[r];
+        names[r] = "";
+        nameLengths[r] = 0;
+        generations[r]++;
+        freeRows.push_back(r);
+        if(deadBytes >= COMPACT_BYTES && deadBytes > arena.GetStats().used - deadBytes)
+          compact();
+      }
+      /**
+       * removes every task, the names are released in one go
+       */
+      void Clear()
+      {
+        for(unsigned int r = 0; r < ids.size(); r++)
+        {
+          if(generations[r] % 2 == 0)
+          {
+            generations[r]++;
+            freeRows.push_back(r);
+          }
+          names[r] = "";
+          nameLengths[r] = 0;
+        }
+        slots.assign(slots.size(), EMPTY);
+        count = 0;
+        allocations += arena.GetStats().allocations;
+        Arena fresh;
+        arena.Swap(fresh);
+        deadBytes = 0;
+      }
+      /** returns a copy of every field of a task */
+      TaskRecord Get(Handle h) const
+      {
+        unsigned int r = row(h);
+        TaskRecord record;
+        record.id = ids[r];
+        record.name.assign(names[r], nameLengths[r]);
+        record.processTime = processTime[r];
+        record.timeRemaining = timeRemaining[r];
+        record.memoryUsage = memoryUsage[r];
+        record.status = static_cast<enum Task::Status>(status[r]);
+        record.level = level[r];
+        record.arrivalTime = arrivalTime[r];
+        record.firstRunTime = firstRunTime[r];
+        record.completionTime = completionTime[r];
+        return record;
+      }
+      /**
+       * calls fn(handle) for every task in the table
+       */
+      template<typename Fn>
+      void ForEach(Fn fn) const
+      {
+        for(unsigned int r = 0; r < ids.size(); r++)
+          if(generations[r] % 2 == 0)
+            fn(handle(r));
+      }
+
+      ull ID(Handle h) const { return ids[row(h)]; }
+      std::string Name(Handle h) const { return std::string(names[row(h)], nameLengths[row(h)]); }
+      ull ProcessTime(Handle h) const { return processTime[row(h)]; }
+      ull TimeRemaining(Handle h) const { return timeRemaining[row(h)]; }
+      ull MemoryUsage(Handle h) const { return memoryUsage[row(h)]; }
+      enum Task::Status Status(Handle h) const { return static_cast<enum Task::Status>(status[row(h)]); }
+      unsigned int Level(Handle h) const { return level[row(h)]; }
+      ull ArrivalTime(Handle h) const { return arrivalTime[row(h)]; }
+      ull FirstRunTime(Handle h) const { return firstRunTime[row(h)]; }
+      ull CompletionTime(Handle h) const { return completionTime[row(h)]; }
+      void SetLevel(Handle h, unsigned int l) { level[row(h)] = l; }
+      void SetArrivalTime(Handle h, ull time) { arrivalTime[row(h)] = time; }
+      void SetFirstRunTime(Handle h, ull time) { firstRunTime[row(h)] = time; }
+      void SetCompletionTime(Handle h, ull time) { completionTime[row(h)] = time; }
+
+      /** sets a task to waiting, see Task::Block */
+      void Block(Handle h) { status[row(h)] = Task::waiting; }
+      /** stops a task that is not done, see Task::Kill */
+      void Kill(Handle h)
+      {
+        unsigned int r = row(h);
+        status[r] = status[r] == Task::done ? Task::done : Task::error;
+        timeRemaining[r] = 0;
+      }
+      /** runs a task for the given time, see Task::Run */
+      void Run(Handle h, ull time)
+      {
+        unsigned int r = row(h);
+        if(status[r] == Task::waiting)
+          status[r] = Task::running;
+        if(status[r] == Task::running)
+        {
+          if(time >= timeRemaining[r])
+          {
+            timeRemaining[r] = 0;
+            status[r] = Task::done;
+          }
+          else
+            timeRemaining[r] -= time;
+        }
+      }
+      /**
+       * returns an estimate of the heap memory held by the table in bytes
+       */
+      size_t MemoryFootprint() const
+      {
+        size_t bytes = (timeRemaining.capacity() + processTime.capacity() + memoryUsage.capacity() +
+                        ids.capacity() + arrivalTime.capacity() + firstRunTime.capacity() + completionTime.capacity()) * sizeof(ull);
+        bytes += status.capacity() + level.capacity();
+        bytes += names.capacity() * sizeof(const char*);
+        bytes += (nameLengths.capacity() + generations.capacity() + freeRows.capacity() + slots.capacity()) * sizeof(unsigned int);
+        bytes += arena.GetStats().reserved;
+        return bytes;
+      }
+      /** returns the allocation counters */
+      AllocStats GetAllocStats() const
+      {
+        Arena::Stats names = arena.GetStats();
+        AllocStats s;
+        s.rows = count;
+        s.freeRows = freeRows.size();
+        s.allocations = allocations + names.allocations;
+        s.arenaChunks = names.chunks;
+        s.arenaReserved = names.reserved;
+        s.arenaUsed = names.used;
+        s.compactions = compactions;
+        return s;
+      }
+  };
+  const TaskTable::Handle TaskTable::NONE;
+  const unsigned int TaskTable::EMPTY;
+  const ull TaskTable::COMPACT_BYTES;
+}
+#endif
@@ -1,11 +1,22 @@
 #ifndef THREAD_H
 #define THREAD_H
-#include <map>
 #include <list>
+#include <deque>
+#include <vector>
+#include <array>
+#include <string>
+#include <algorithm>
+#include <atomic>
 #ifndef ull
 #define ull unsigned long long
 #endif
 #include "task.h"
+#include "tasktable.h"
+#include "lock.h"
+#include "readyqueue.h"
+#include "histogram.h"
+#include "trace.h"
+#include "boundedqueue.h"
 namespace Shell
 {
   /**
@@ -15,7 +26,69 @@ namespace Shell
   class Thread
   {
     public:
-      enum ScheduleType {fifo, roundrobin2, shortestprocess};
+      enum ScheduleType {fifo, roundrobin, shortestprocess, multilevel, shortestremaining};
+      /**
+       * quantum round robin threads use unless given one, also the
+       * quantum of the top level of a multilevel thread
+       */
+      static const ull DEFAULT_QUANTUM = 2;
+      /**
+       * number of priority levels of a multilevel thread, each level
+       * down doubles the quantum
+       */
+      static const unsigned int MLFQ_LEVELS = 3;
+      /**
+       * a multilevel thread moves every task back to the top level each
+       * time this many quanta of the top level have passed
+       */
+      static const ull MLFQ_BOOST_QUANTA = 50;
+      /**
+       * number of finished tasks a thread keeps unless told otherwise
+       */
+      static const ull DEFAULT_RETAIN_COUNT = 1000;
+      /**
+       * number of submitted tasks that can wait to be taken in before
+       * Submit has to take the lock and take them in itself
+       */
+      static const size_t SUBMIT_CAPACITY = 4096;
+      /**
+       * counters of finished tasks that were dropped by the retention policy
+       */
+      struct History
+      {
+        /** tasks that ran to completion and were dropped */
+        ull done;
+        /** tasks that were killed and were dropped */
+        ull killed;
+        /** latest completion time of a dropped task */
+        ull lastCompletion;
+      };
+      /**
+       * counters of the tasks given to Submit
+       */
+      struct SubmitStats
+      {
+        /** tasks submitted */
+        ull submitted;
+        /** submitted tasks not yet taken in by an update */
+        ull queued;
+        /** taken in tasks that were too large for the thread or had an id it already holds */
+        ull rejected;
+        /** most tasks taken in at once */
+        ull largestDrain;
+      };
+      /**
+       * distributions over the tasks that ran to completion
+       */
+      struct Metrics
+      {
+        /** time spent ready but not running, turnaround minus process time */
+        Histogram wait;
+        /** time from arrival until first run */
+        Histogram response;
+        /** time from arrival until completion */
+        Histogram turnaround;
+      };
       static ScheduleType IntToType(const int i)
       {
         ScheduleType t;
@@ -24,21 +97,38 @@ namespace Shell
           case fifo:
             t = fifo;
             break;
-          case roundrobin2:
-            t = roundrobin2;
+          case roundrobin:
+            t = roundrobin;
             break;
           case shortestprocess:
             t = shortestprocess;
             break;
+          case multilevel:
+            t = multilevel;
+            break;
+          case shortestremaining:
+            t = shortestremaining;
+            break;
           default:
             t = fifo;
             break;
         }
         return t;
       }
-      static std::array<std::string, 3> TypeName;
+      static std::array<std::string, 5> TypeName;
+      /** returns the length of the longest schedule type name */
+      static size_t TypeNameWidth()
+      {
+        size_t width = 0;
+        for(const std::string& name : TypeName)
+          width = std::max(width, name.size());
+        return width;
+      }
     private:
-      bool isLocked;
+      /**
+       * guards the task containers between the updater and the console
+       */
+      AdaptiveMutex lock;
       /**
        * Type of Schedule this thread uses
        */
@@ -46,23 +136,64 @@ namespace Shell
       /**
        * Counter to make sure each Thread has a unique Identifier
        */
-      static ull ID_COUNT;
+      static std::atomic<ull> ID_COUNT;
+      /**
+       * table of all tasks on thread
+       */
+      TaskTable tasks;
+      /**
+       * tasks in order of arrival waiting to be processed.
+       */
+      std::deque<TaskTable::Handle> waiting;
       /**
-       * dictionary of all tasks on thread
+       * tasks waiting to be processed ordered by process time, or time
+       * remaining for shortestremaining, used instead of waiting
        */
-      std::map<ull, Task*> tasks;
+      ReadyHeap shortest;
       /**
-       * list of IDs in order of arrival waiting to be processed.
+       * tasks waiting to be processed per priority level in order of
+       * arrival, used instead of waiting by multilevel
        */
-      std::list<ull> waitingIDs;
+      std::array<std::deque<TaskTable::Handle>, MLFQ_LEVELS> levels;
+      /**
+       * clock value at which multilevel moves every task back to the top
+       */
+      ull nextBoost;
+      /**
+       * tasks in order of arrival that are waiting for enough free memory
+       * before they can be scheduled.
+       */
+      std::deque<TaskTable::Handle> pending;
+      /**
+       * if pending tasks that fit the free memory may be admitted ahead
+       * of earlier ones that do not
+       */
+      bool preferFit;
       /** 
-       * list of IDs in order of completion of being processed.
+       * tasks in order of completion of being processed,
+       * only the ones still retained.
+       */
+      std::deque<TaskTable::Handle> finished;
+      /**
+       * number of tasks that finished, retained or not
+       */
+      ull finishedCount;
+      /**
+       * most finished tasks to keep, older ones are dropped
+       */
+      ull retainCount;
+      /**
+       * finished tasks older than this are dropped, 0 keeps them regardless of age
+       */
+      ull retainAge;
+      /**
+       * what is left of the dropped finished tasks
        */
-      std::list<ull> finishedIDs;
+      History history;
       /**
        * current task running
        */
-      Task* runningTask;
+      TaskTable::Handle running;
       /**
        * total memory this thread has access to
        */
@@ -75,110 +206,345 @@ namespace Shell
        * id of this thread
        */
       ull id;
+      /**
+       * time a task may run before it is preempted, used by roundrobin
+       */
+      ull quantum;
+      /**
+       * time the running task has used of its current quantum
+       */
+      ull quantumUsed;
+      /**
+       * simulated time this thread has been updated for
+       */
+      ull clock;
+      /**
+       * number of tasks that ran to completion
+       */
+      ull completedCount;
+      /**
+       * sum and maximum of the turnaround times of completed tasks
+       */
+      ull turnaroundTotal;
+      ull turnaroundMax;
+      /**
+       * wait, response and turnaround times of completed tasks
+       */
+      Metrics metrics;
+      /**
+       * number of tasks taken from other threads and given to other threads
+       */
+      ull stolenCount;
+      ull donatedCount;
+      /**
+       * if scheduler events are recorded, and the ones not yet collected
+       */
+      bool tracing;
+      std::vector<TraceEvent> traceEvents;
+      /**
+       * tasks given to Submit, pushed without the lock and taken in
+       * while holding it. Made by the first Submit so threads that are
+       * only given tasks with AddTask(s) do not pay for its cells, after
+       * that submitting only allocates for names too long to be kept in
+       * place.
+       */
+      std::atomic<BoundedQueue<TaskRecord>*> inbox;
+      /**
+       * tasks submitted and the ones of them taken in, read without the lock
+       */
+      std::atomic<ull> submittedCount;
+      std::atomic<ull> drainedCount;
+      ull submitRejected;
+      ull largestDrain;
     public:
       /**
        * Initialize a Thread 
        * @param  mem  memory this thread starts with
+       * @param  t  scheduling type of this thread
+       * @param  q  quantum used by roundrobin, at least 1
        */
-      Thread(ull mem, ScheduleType t) : type(t), memory(mem), freeMemory(mem), id(ID_COUNT++) { runningTask = nullptr; isLocked = false; }
+      Thread(ull mem, ScheduleType t, ull q = DEFAULT_QUANTUM) : type(t), preferFit(false), finishedCount(0),
+        retainCount(DEFAULT_RETAIN_COUNT), retainAge(0), memory(mem), freeMemory(mem), id(ID_COUNT++), quantum(q == 0 ? 1 : q), quantumUsed(0), clock(0),
+        completedCount(0), turnaroundTotal(0), turnaroundMax(0), stolenCount(0), donatedCount(0), tracing(false),
+        inbox(nullptr), submittedCount(0), drainedCount(0), submitRejected(0), largestDrain(0)
+      {
+        running = TaskTable::NONE;
+        nextBoost = quantum * MLFQ_BOOST_QUANTA;
+        history.done = 0;
+        history.killed = 0;
+        history.lastCompletion = 0;
+      }
       /**
        * Deconstructs the Thread
-       * handles its dictionary of pointers
+       * the table releases every task with it
        */
       ~Thread()
       {
-        // std::cout << "Deconstructing on thread: " << id << std::endl;
         GetLock();
-        for(auto taskPair : tasks)
-          delete taskPair.second;
-
-        runningTask = nullptr;
-
-        tasks.empty();
+        running = TaskTable::NONE;
+        tasks.Clear();
+        Unlock();
+        delete inbox.load();
       }
-      int NumTasks() const { return tasks.size(); }
-      int NumWaitingTasks() const { return waitingIDs.size(); }
-      int NumFinishedTasks() const { return finishedIDs.size(); }
-      bool Locked() const { return isLocked; }
+      int NumTasks() const { return tasks.Size(); }
+      int NumWaitingTasks() const { return numReady() + pending.size(); }
+      /** returns the number of waiting tasks that are held back for memory */
+      int NumPendingTasks() const { return pending.size(); }
+      int NumFinishedTasks() const { return finishedCount; }
+      /** returns the number of finished tasks still kept by the thread */
+      int NumRetainedTasks() const { return finished.size(); }
+      /** returns the counters of finished tasks that were dropped */
+      History GetHistory() const { return history; }
+      /** returns the most finished tasks kept */
+      ull RetainCount() const { return retainCount; }
+      /** returns the age after which finished tasks are dropped, 0 if never */
+      ull RetainAge() const { return retainAge; }
+      /**
+       * Sets how many finished tasks are kept and for how long
+       * @param  count  most finished tasks to keep
+       * @param  age  simulated time a finished task is kept for, 0 for no limit
+       */
+      void SetRetention(ull count, ull age)
+      {
+        GetLock();
+        retainCount = count;
+        retainAge = age;
+        retire();
+        Unlock();
+      }
+      bool Locked() const { return lock.IsLocked(); }
+      /** returns the contention counters of this thread's lock */
+      AdaptiveMutex::Stats LockStats() const { return lock.GetStats(); }
+      /** resets the contention counters of this thread's lock */
+      void ResetLockStats() { lock.ResetStats(); }
       /** returns the Type of the thread scheduling */
       ScheduleType Type() const { return type; }
+      /** returns the round robin quantum of the thread */
+      ull Quantum() const { return quantum; }
+      /** returns the name of the scheduling type, with the quantum for round robin and multilevel */
+      std::string TypeString() const
+      {
+        return type == roundrobin || type == multilevel ? TypeName[type] + " " + std::to_string(quantum) : TypeName[type];
+      }
       /** returns the ID of the thread */
       ull ID() const { return id; }
       /** returns the total Memory of the thread */ 
       ull TotalMemory() const { return memory; }
       /** returns the free Memory of the thread */
       ull FreeMemory() const { return freeMemory; }
-      /** returns if the thread has a running task with the given id */
-      bool HasTask(ull id) const { return tasks.find(id) == tasks.end(); }
-      /** returns the list of waiting ids since the start of this thread */
-      const std::list<ull> WaitingIDs() const { return waitingIDs; }
-      /** returns the list of finished ids since the start of this thread */
-      const std::list<ull> FinishedIDs() const { return finishedIDs; }
-      /** returns if the thread has a finished task with the given id */
+      /** returns the Memory reserved by admitted tasks */
+      ull UsedMemory() const { return memory - freeMemory; }
+      /** returns an estimate of the memory held by the task table in bytes */
+      size_t TableFootprint() const { return tasks.MemoryFootprint(); }
+      /** returns the allocation counters of the task table */
+      TaskTable::AllocStats AllocStats()
+      {
+        GetLock();
+        TaskTable::AllocStats stats = tasks.GetAllocStats();
+        Unlock();
+        return stats;
+      }
+      /** returns if pending tasks that fit may skip ahead of ones that don't */
+      bool PreferFit() const { return preferFit; }
+      /**
+       * Sets if pending tasks that fit the free memory may be admitted
+       * ahead of earlier ones that do not, otherwise they wait in order
+       */
+      void SetPreferFit(bool prefer)
+      {
+        GetLock();
+        preferFit = prefer;
+        admitPending();
+        Unlock();
+      }
+      /** returns if the thread has a task with the given id */
+      bool HasTask(ull _id) const { return tasks.Find(_id) != TaskTable::NONE; }
+      /** returns the list of ready ids, unordered for the shortest types */
+      const std::list<ull> WaitingIDs() const
+      {
+        std::list<ull> ids;
+        if(usesHeap())
+        {
+          for(ull h : shortest.IDs())
+            ids.push_back(tasks.ID(h));
+        }
+        else if(type == multilevel)
+        {
+          for(auto& level : levels)
+            for(TaskTable::Handle h : level)
+              ids.push_back(tasks.ID(h));
+        }
+        else
+        {
+          for(TaskTable::Handle h : waiting)
+            ids.push_back(tasks.ID(h));
+        }
+        return ids;
+      }
+      /** returns the list of retained finished ids */
+      const std::list<ull> FinishedIDs() const
+      {
+        std::list<ull> ids;
+        for(TaskTable::Handle h : finished)
+          ids.push_back(tasks.ID(h));
+        return ids;
+      }
+      /** returns if the thread has a retained finished task with the given id */
       bool HasCompletedTask(ull _id) const 
       { 
-        auto taskIt = tasks.find(_id);
-        return taskIt == tasks.end() ? false : taskIt->second->Status() == Task::done; 
+        TaskTable::Handle h = tasks.Find(_id);
+        return h == TaskTable::NONE ? false : tasks.Status(h) == Task::done; 
+      }
+      /**
+       * gets a copy of all the tasks on the thread
+       * @return  every task the thread holds
+       */
+      std::vector<TaskRecord> GetTasks() const
+      {
+        std::vector<TaskRecord> records;
+        tasks.ForEach([&](TaskTable::Handle h) { records.push_back(tasks.Get(h)); });
+        return records;
       }
       /**
-       * gets all the task from the thread
-       * NOTE: modifying the pointers will cause undefined behavior
-       *       pointers should be treated like const Task* const
-       * @return  map of all tasks
+       * gets a copy of every task the thread has not finished, including
+       * submitted ones it has not taken in yet
+       * @return  running, waiting and pending tasks
        */
-      const std::map<ull, Task*> GetTasks() const { return tasks; }
+      std::vector<TaskRecord> LiveTasks()
+      {
+        GetLock();
+        drainInbox();
+        std::vector<TaskRecord> records;
+        tasks.ForEach([&](TaskTable::Handle h)
+        {
+          if(tasks.Status(h) != Task::done)
+            records.push_back(tasks.Get(h));
+        });
+        Unlock();
+        return records;
+      }
       /** 
        * Gets a task from the thread
        * @param  iD  id of the task you want
-       * @return  returns the task if there is one
+       * @param  task  filled with a copy of the task if there is one
+       * @return  returns if there is one
        */
-      const Task* const GetTask(ull iD) const
+      bool GetTask(ull iD, TaskRecord& task) const
       {
-        Task* task;
-        auto taskIt = tasks.find(iD);
-        if(taskIt != tasks.end()) 
-          task = taskIt->second;
-        else 
-          task = nullptr;
-
-        return task;
+        TaskTable::Handle h = tasks.Find(iD);
+        if(h == TaskTable::NONE)
+          return false;
+        task = tasks.Get(h);
+        return true;
       }
+      /** returns if a task is running */
+      bool HasRunningTask() const { return running != TaskTable::NONE; }
       /**
        * Gets the current running task from the thread
-       * @return  returns the task if there is one that is running.
+       * @param  task  filled with a copy of the running task if there is one
+       * @return  returns if there is one that is running.
        */
-      const Task* const GetRunningTask() const
+      bool GetRunningTask(TaskRecord& task)
       {
-        return runningTask;
+        GetLock();
+        bool found = running != TaskTable::NONE;
+        if(found)
+          task = tasks.Get(running);
+        Unlock();
+        return found;
       }
       /**
-       * Adds a task to the thread to start running
-       * @param  task  A pointer to a task to be added
+       * Adds a copy of a task to the thread to start running
+       * @param  task  the task to be added
        * @return  true if added to thread running task false otherwise
        * 
-       * if added caller cleanup unnecessary else caller in charge of 
-       * handing pointer if not added.
+       * the thread keeps its own copy so the caller keeps ownership of
+       * the task. A task needing more memory than the thread has in
+       * total is not added. One that needs more than is currently free
+       * is held as pending until memory is released.
        */
-      bool AddTask(Task* task) 
-      { 
+      bool AddTask(const Task& task)
+      {
+        GetLock();
+        TaskTable::Handle h = admit(tasks.Insert(task), task.MemoryUsage(), true);
+        if(h != TaskTable::NONE)
+          trace(TraceEvent::add, h);
+        Unlock();
+        return h != TaskTable::NONE;
+      }
+      /**
+       * Adds copies of many tasks under a single hold of the lock
+       * @param  batch  tasks to add, in arrival order
+       * @param  added  if given, filled with whether each task was added
+       * @return  number of tasks added
+       *
+       * Same rules as AddTask. The table is grown once for the whole
+       * batch and pending tasks are only admitted once at the end.
+       */
+      size_t AddTasks(const std::vector<Task>& batch, std::vector<bool>* added = nullptr)
+      {
+        if(added != nullptr)
+          added->assign(batch.size(), false);
         GetLock();
-        bool added = false;
-        /*
-        if(task->MemoryUsage() <= freeMemory)
+        tasks.Reserve(batch.size());
+        size_t count = 0;
+        for(size_t i = 0; i < batch.size(); i++)
         {
-          */
-          added = tasks.emplace(task->ID(), task).second;
-          if(added)
-          {
-            //freeMemory -= task->MemoryUsage();
-            waitingIDs.push_back(task->ID());
-            task->Block();
-          }
-          /*
+          TaskTable::Handle h = batch[i].MemoryUsage() > memory ? TaskTable::NONE :
+            admit(tasks.Insert(batch[i]), batch[i].MemoryUsage(), false);
+          if(h == TaskTable::NONE)
+            continue;
+          trace(TraceEvent::add, h);
+          if(added != nullptr)
+            (*added)[i] = true;
+          count++;
         }
-        */
+        admitPending();
         Unlock();
-        return added; 
+        return count;
+      }
+      /**
+       * Queues a copy of a task to be added at the start of the next
+       * Update or NextEvent, only waits on the lock if SUBMIT_CAPACITY
+       * tasks are already queued
+       * @param  task  the task to be added
+       *
+       * Same rules as AddTask once taken in, the tasks the thread
+       * cannot hold are only counted in GetSubmitStats.
+       */
+      void Submit(const Task& task)
+      {
+        submittedCount.fetch_add(1, std::memory_order_relaxed);
+        push(TaskTable::Record(task));
+      }
+      /**
+       * Queues copies of many tasks, see Submit
+       * @param  batch  tasks to add, in arrival order
+       */
+      void Submit(const std::vector<Task>& batch)
+      {
+        submittedCount.fetch_add(batch.size(), std::memory_order_relaxed);
+        for(const Task& task : batch)
+          push(TaskTable::Record(task));
+      }
+      /** returns the number of submitted tasks not yet taken in */
+      ull NumQueuedSubmissions() const
+      {
+        // drained first, it never passes submitted
+        ull drained = drainedCount.load(std::memory_order_acquire);
+        return submittedCount.load(std::memory_order_relaxed) - drained;
+      }
+      /** returns the counters of submitted tasks */
+      SubmitStats GetSubmitStats()
+      {
+        GetLock();
+        SubmitStats stats;
+        stats.queued = NumQueuedSubmissions();
+        stats.submitted = submittedCount.load(std::memory_order_relaxed);
+        stats.rejected = submitRejected;
+        stats.largestDrain = largestDrain;
+        Unlock();
+        return stats;
       }
 
       /**
@@ -189,22 +555,34 @@ namespace Shell
       bool KillTask(ull _id)
       {
         GetLock();
+        drainInbox();
         bool killed = false;
-        auto taskIt = tasks.find(_id);
-        if(_id == runningTask->ID())
+        TaskTable::Handle h = tasks.Find(_id);
+        if(h != TaskTable::NONE && h == running)
         {
           killed = true;
-          runningTask->Kill();
-          finishedIDs.push_back(_id);
-          runningTask = nullptr;
+          trace(TraceEvent::kill, running);
+          tasks.Kill(running);
+          finishTask(running);
+          releaseMemory(running);
+          running = TaskTable::NONE;
         }
-        else if(taskIt != tasks.end())
+        else if(h != TaskTable::NONE && tasks.Status(h) == Task::waiting)
         {
           killed = true;
-          taskIt->second->Kill();
-          finishedIDs.push_back(taskIt->second->ID());
-          waitingIDs.remove(_id);
+          trace(TraceEvent::kill, h);
+          tasks.Kill(h);
+          finishTask(h);
+          auto pendingIt = std::find(pending.begin(), pending.end(), h);
+          if(pendingIt != pending.end())
+            pending.erase(pendingIt);
+          else
+          {
+            removeReady(h);
+            releaseMemory(h);
+          }
         }
+        retire();
         Unlock();
         return killed;
       }
@@ -215,182 +593,614 @@ namespace Shell
        * @return list of finished tasks for this call
        * 
        * the update function of a thread, Should be called by 
-       * the "Computer" with time since last call.
+       * the "Computer" with time since last call. Any amount of time
+       * may be passed, tasks finishing part way through are stamped
+       * with the exact simulated time they finished at.
        */
-     std::list<ull> Update(ull time)
+      std::list<ull> Update(ull time)
       {
-        static ull pTime = 0;
-        static Task* pTask = nullptr;
-        // std::cout << "Update Function called on thread: " << id << std::endl;
         GetLock();
-        // std::cout << "Finished locking on thread: " << id << std::endl;
+        drainInbox();
         std::list<ull> completedIDs;
-        if(runningTask == nullptr && waitingIDs.size() == 0)
+        if(running == TaskTable::NONE)
+          running = nextTask();
+        else
+          preemptIfNeeded();
+        while(running != TaskTable::NONE)
         {
-          Unlock();
-          return completedIDs;
+          ull slice = std::min(time, tasks.TimeRemaining(running));
+          ull slot = currentQuantum();
+          if(slot > 0)
+            slice = std::min(slice, slot - quantumUsed);
+          if(type == multilevel)
+            slice = std::min(slice, nextBoost > clock ? nextBoost - clock : 0);
+          tasks.Run(running, slice);
+          time -= slice;
+          clock += slice;
+          quantumUsed += slice;
+          if(type == multilevel && clock >= nextBoost)
+            boost();
+          if(tasks.Status(running) == Task::done)
+          {
+            completeTask(running);
+            completedIDs.push_back(tasks.ID(running));
+            running = nextTask();
+          }
+          else if(slot > 0 && quantumUsed >= slot)
+          {
+            // used up its quantum, multilevel also drops it a level
+            if(type == multilevel && tasks.Level(running) < MLFQ_LEVELS - 1)
+              tasks.SetLevel(running, tasks.Level(running) + 1);
+            trace(TraceEvent::block, running);
+            tasks.Block(running);
+            queueTask(running);
+            running = nextTask();
+          }
+          else if(time == 0)
+            break;
         }
+        // idle time still moves the clock forward
+        clock += time;
+        retire();
+        Unlock();
+        return completedIDs;
+      }
+
+      /**
+       * Time until the next scheduling event on this thread
+       * @return  time until the running task finishes or is preempted,
+       *          0 if that happens immediately or the thread is idle
+       *
+       * Dispatches a waiting task if nothing is running so the answer
+       * accounts for it.
+       */
+      ull NextEvent()
+      {
+        GetLock();
+        drainInbox();
+        if(running == TaskTable::NONE)
+          running = nextTask();
+        else
+          preemptIfNeeded();
+        ull next = 0;
+        if(running != TaskTable::NONE)
+        {
+          next = tasks.TimeRemaining(running);
+          ull slot = currentQuantum();
+          if(slot > 0)
+            next = std::min(next, slot - quantumUsed);
+          if(type == multilevel)
+            next = std::min(next, nextBoost > clock ? nextBoost - clock : 0);
+        }
+        Unlock();
+        return next;
+      }
+      /** returns if the thread has a running, waiting or submitted task */
+      bool Busy() const { return running != TaskTable::NONE || NumWaitingTasks() > 0 || NumQueuedSubmissions() > 0; }
+      /** returns the simulated time this thread has been updated for */
+      ull Clock() const { return clock; }
+      /** returns the number of tasks that ran to completion */
+      ull NumCompletedTasks() const { return completedCount; }
+      /** returns the sum of the turnaround times of completed tasks */
+      ull TotalTurnaround() const { return turnaroundTotal; }
+      /** returns the longest turnaround time of a completed task */
+      ull MaxTurnaround() const { return turnaroundMax; }
+      /** returns if scheduler events are being recorded */
+      bool Tracing() const { return tracing; }
+      /**
+       * Starts or stops recording scheduler events,
+       * stopping drops the ones not yet collected
+       */
+      void SetTracing(bool on)
+      {
+        GetLock();
+        tracing = on;
+        if(!on)
+          traceEvents.clear();
+        Unlock();
+      }
+      /**
+       * Moves the recorded events to the end of events
+       * @param  events  where to put them, in the order they happened
+       */
+      void DrainTrace(std::vector<TraceEvent>& events)
+      {
+        GetLock();
+        events.insert(events.end(), traceEvents.begin(), traceEvents.end());
+        traceEvents.clear();
+        Unlock();
+      }
+      /** returns a copy of the wait, response and turnaround distributions */
+      Metrics GetMetrics()
+      {
+        GetLock();
+        Metrics copy = metrics;
+        Unlock();
+        return copy;
+      }
+      /** returns the number of tasks stolen from other threads */
+      ull NumStolenTasks() const { return stolenCount; }
+      /** returns the number of tasks other threads stole from this one */
+      ull NumDonatedTasks() const { return donatedCount; }
 
-        if(runningTask == nullptr)
+      /**
+       * Gives up waiting tasks so an idle thread can run them
+       * @param  max  most tasks to give up
+       * @param  maxMemory  largest memory usage of a task the taker can hold
+       * @return  copies of the tasks, they are removed from this thread
+       *
+       * Tasks held back for memory go first, then ready tasks from the
+       * opposite end the thread dispatches from so the tasks this thread
+       * would run next stay with it. Arrival times are left relative to
+       * this thread's clock, see AcceptTasks.
+       */
+      std::vector<TaskRecord> DonateTasks(size_t max, ull maxMemory)
+      {
+        GetLock();
+        std::vector<TaskRecord> donated;
+        for(auto pendingIt = pending.begin(); pendingIt != pending.end() && donated.size() < max;)
         {
-          if(type == fifo || type == roundrobin2)
+          if(tasks.MemoryUsage(*pendingIt) <= maxMemory)
           {
-            runningTask = tasks[waitingIDs.front()];
-            waitingIDs.pop_front();
+            trace(TraceEvent::donate, *pendingIt);
+            donated.push_back(tasks.Get(*pendingIt));
+            tasks.Erase(*pendingIt);
+            pendingIt = pending.erase(pendingIt);
           }
-          else if(type == shortestprocess)
+          else
+            ++pendingIt;
+        }
+        std::vector<TaskTable::Handle> kept;
+        while(donated.size() < max && numReady() > 0)
+        {
+          TaskTable::Handle h = popReadyBack();
+          if(tasks.MemoryUsage(h) > maxMemory)
           {
-            ull _id = waitingIDs.front();
-            for (auto id : waitingIDs)
-            {
-              if(tasks[_id]->ProcessTime() > tasks[id]->ProcessTime())
-                _id = id;
-            }
-            runningTask = tasks[_id];
-            waitingIDs.remove(_id);
+            kept.push_back(h);
+            continue;
           }
+          freeMemory += tasks.MemoryUsage(h);
+          trace(TraceEvent::donate, h);
+          donated.push_back(tasks.Get(h));
+          tasks.Erase(h);
         }
-        switch (type)
+        // put back the ones too big for the taker, in their original order
+        for(auto keptIt = kept.rbegin(); keptIt != kept.rend(); ++keptIt)
+          queueTask(*keptIt);
+        admitPending();
+        donatedCount += donated.size();
+        Unlock();
+        return donated;
+      }
+      /**
+       * Gives up one waiting task, used to repeat a recorded steal
+       * @param  _id  id of the task
+       * @param  task  filled with a copy of the task if it was given up
+       * @return  false if the task is not waiting on this thread
+       */
+      bool DonateTask(ull _id, TaskRecord& task)
+      {
+        GetLock();
+        drainInbox();
+        TaskTable::Handle h = tasks.Find(_id);
+        bool donated = h != TaskTable::NONE && h != running && tasks.Status(h) == Task::waiting;
+        if(donated)
         {
-          case fifo:
-            while(time > 0)
-            {
-              ull left = runningTask->TimeRemaining();
-              runningTask->Run(time);
-              if(time > left)
-                time -= left;
-              else time = 0;
-              if(runningTask->Status() == Task::done)
-              {
-                completedIDs.push_back(runningTask->ID());
-                finishedIDs.push_back(runningTask->ID());
-                if(waitingIDs.size() > 0)
-                {
-                  runningTask = tasks[waitingIDs.front()];
-                  waitingIDs.pop_front();
-                }
-                else
-                {
-                  runningTask = nullptr;
-                  break;
-                }
-                
-              }
-            }
-            break;
-          case roundrobin2: 
+          auto pendingIt = std::find(pending.begin(), pending.end(), h);
+          if(pendingIt != pending.end())
+            pending.erase(pendingIt);
+          else
           {
-            while (time > 0)
-            {
-              if(pTask == runningTask)
-              {
-                if(pTime < 2)
-                {
-                  unsigned int running = 2 - pTime;
-                  if(time >= running)
-                  {
-                    time -= running;
-                    runningTask->Run(running);
-                    pTask = nullptr;
-                    pTime = 0;
-                  }
-                  else
-                  {
-                    pTime += time;
-                    runningTask->Run(time);
-                    time = 0;
-                  }
-                }
-                else
-                {
-                  pTask = nullptr;
-                  pTime = 0;
-                }
-              }
-              else
-              {
-                pTask = runningTask;
-              }
-              
-              if(runningTask->Status() == Task::done)
-              {
-                completedIDs.push_back(runningTask->ID());
-                finishedIDs.push_back(runningTask->ID());
-                if(waitingIDs.size() > 0)
-                {
-                  runningTask = tasks[waitingIDs.front()];
-                  waitingIDs.pop_front();
-                }
-                else
-                {
-                  runningTask = nullptr;
-                  break;
-                }
-              }
-              else if(pTask == nullptr)
-              {
-                runningTask->Block();
-                waitingIDs.push_back(runningTask->ID());
-                runningTask = tasks[waitingIDs.front()];
-                waitingIDs.pop_front();
-              }
-            }
-            break;
+            removeReady(h);
+            freeMemory += tasks.MemoryUsage(h);
           }
-          case shortestprocess: 
+          trace(TraceEvent::donate, h);
+          task = tasks.Get(h);
+          tasks.Erase(h);
+          admitPending();
+          donatedCount++;
+        }
+        Unlock();
+        return donated;
+      }
+      /**
+       * Takes over tasks donated by another thread
+       * @param  stolen  tasks from DonateTasks
+       * @param  donorClock  clock of the donating thread
+       * @return  number of tasks taken
+       *
+       * Time already spent waiting on the donor is kept so turnaround
+       * is measured from the original arrival.
+       */
+      size_t AcceptTasks(const std::vector<TaskRecord>& stolen, ull donorClock)
+      {
+        GetLock();
+        size_t accepted = 0;
+        for(const TaskRecord& task : stolen)
+        {
+          ull waited = donorClock - task.arrivalTime;
+          TaskTable::Handle h = admit(tasks.Insert(task), task.memoryUsage, true);
+          if(h != TaskTable::NONE)
           {
-            while(time > 0)
-            {
-              ull _id;
-              ull left = runningTask->TimeRemaining();
-              runningTask->Run(time);
-              if(time > left)
-                time -= left;
-              else time = 0;
-              if(runningTask->Status() == Task::done)
-              {
-                completedIDs.push_back(runningTask->ID());
-                finishedIDs.push_back(runningTask->ID());
-                if(waitingIDs.size() > 0)
-                {
-                  _id = waitingIDs.front();
-                  for (auto id : waitingIDs)
-                  {
-                    if(tasks[_id]->ProcessTime() > tasks[id]->ProcessTime())
-                      _id = id;
-                  }
-                  runningTask = tasks[_id];
-                  waitingIDs.remove(_id);
-                }
-                else
-                {
-                  runningTask = nullptr;
-                  break;
-                }
-              }
-            }
-            break;
+            ull arrival = clock > waited ? clock - waited : 0;
+            tasks.SetArrivalTime(h, arrival);
+            if(task.firstRunTime != Task::NOT_RUN)
+              tasks.SetFirstRunTime(h, arrival + (task.firstRunTime - task.arrivalTime));
+            trace(TraceEvent::accept, h);
+            accepted++;
           }
         }
+        stolenCount += accepted;
         Unlock();
-        return completedIDs;
+        return accepted;
       }
     private:
+      /**
+       * starts scheduling a task just put in the table, or takes it back
+       * out if the thread could never hold it
+       * @param  h  handle from TaskTable::Insert, NONE if that failed
+       * @param  mem  memory the task needs
+       * @param  settle  if pending tasks are admitted right away, batches
+       *                 do that once at the end instead
+       * @return  the handle or NONE if not admitted
+       */
+      TaskTable::Handle admit(TaskTable::Handle h, ull mem, bool settle)
+      {
+        if(h == TaskTable::NONE)
+          return h;
+        if(mem > memory)
+        {
+          tasks.Erase(h);
+          return TaskTable::NONE;
+        }
+        tasks.Block(h);
+        tasks.SetArrivalTime(h, clock);
+        tasks.SetFirstRunTime(h, Task::NOT_RUN);
+        tasks.SetLevel(h, 0);
+        if(pending.empty() && mem <= freeMemory)
+        {
+          freeMemory -= mem;
+          queueTask(h);
+        }
+        else
+        {
+          pending.push_back(h);
+          if(settle)
+            admitPending();
+        }
+        return h;
+      }
+      /**
+       * puts a submitted task in the inbox, taking in the ones already
+       * there under the lock if it is full
+       */
+      void push(TaskRecord task)
+      {
+        BoundedQueue<TaskRecord>* queue = inbox.load(std::memory_order_acquire);
+        if(queue == nullptr)
+        {
+          // producers racing to make it keep the first one
+          BoundedQueue<TaskRecord>* made = new BoundedQueue<TaskRecord>(SUBMIT_CAPACITY);
+          if(inbox.compare_exchange_strong(queue, made, std::memory_order_acq_rel))
+            queue = made;
+          else
+            delete made;
+        }
+        while(!queue->TryPush(task))
+        {
+          GetLock();
+          drainInbox();
+          Unlock();
+        }
+      }
+      /**
+       * takes in every task given to Submit so far, in the order they
+       * were submitted, as if they were given to AddTasks
+       */
+      void drainInbox()
+      {
+        BoundedQueue<TaskRecord>* queue = inbox.load(std::memory_order_acquire);
+        if(queue == nullptr)
+          return;
+        TaskRecord task;
+        ull drained = 0;
+        while(queue->TryPop(task))
+        {
+          TaskTable::Handle h = task.memoryUsage > memory ? TaskTable::NONE :
+            admit(tasks.Insert(task), task.memoryUsage, false);
+          if(h == TaskTable::NONE)
+            submitRejected++;
+          else
+            trace(TraceEvent::add, h);
+          drained++;
+        }
+        if(drained == 0)
+          return;
+        admitPending();
+        largestDrain = std::max(largestDrain, drained);
+        drainedCount.fetch_add(drained, std::memory_order_release);
+      }
+      /**
+       * records a scheduler event of a task if tracing
+       */
+      void trace(TraceEvent::Type event, TaskTable::Handle h)
+      {
+        if(!tracing)
+          return;
+        TraceEvent e;
+        e.type = event;
+        e.threadId = id;
+        e.time = clock;
+        e.task = tasks.ID(h);
+        e.processTime = 0;
+        e.memory = 0;
+        e.preferFit = false;
+        e.retainCount = 0;
+        e.retainAge = 0;
+        if(event == TraceEvent::add)
+        {
+          e.processTime = tasks.ProcessTime(h);
+          e.memory = tasks.MemoryUsage(h);
+          e.name = tasks.Name(h);
+        }
+        traceEvents.push_back(e);
+      }
+      /**
+       * records a task that ran to completion
+       */
+      void completeTask(TaskTable::Handle h)
+      {
+        trace(TraceEvent::finish, h);
+        releaseMemory(h);
+        finishTask(h);
+        ull turnaround = clock - tasks.ArrivalTime(h);
+        turnaroundTotal += turnaround;
+        turnaroundMax = std::max(turnaroundMax, turnaround);
+        completedCount++;
+        metrics.turnaround.Record(turnaround);
+        metrics.response.Record(tasks.FirstRunTime(h) - tasks.ArrivalTime(h));
+        ull processTime = tasks.ProcessTime(h);
+        metrics.wait.Record(turnaround > processTime ? turnaround - processTime : 0);
+      }
+      /**
+       * stamps a task that is done or killed and keeps it as finished
+       */
+      void finishTask(TaskTable::Handle h)
+      {
+        tasks.SetCompletionTime(h, clock);
+        finished.push_back(h);
+        finishedCount++;
+      }
+      /**
+       * drops the oldest finished tasks beyond the retention count or
+       * age, folding them into the history counters
+       */
+      void retire()
+      {
+        while(!finished.empty())
+        {
+          TaskTable::Handle h = finished.front();
+          if(finished.size() <= retainCount &&
+             (retainAge == 0 || clock - tasks.CompletionTime(h) <= retainAge))
+            break;
+          if(tasks.Status(h) == Task::done)
+            history.done++;
+          else
+            history.killed++;
+          history.lastCompletion = std::max(history.lastCompletion, tasks.CompletionTime(h));
+          tasks.Erase(h);
+          finished.pop_front();
+        }
+      }
+      /**
+       * gives back the memory of an admitted task and admits pending
+       * tasks that now fit
+       */
+      void releaseMemory(TaskTable::Handle h)
+      {
+        freeMemory += tasks.MemoryUsage(h);
+        admitPending();
+      }
+      /**
+       * moves pending tasks into the ready structure while they fit,
+       * in arrival order unless preferFit lets later ones skip ahead
+       */
+      void admitPending()
+      {
+        for(auto pendingIt = pending.begin(); pendingIt != pending.end();)
+        {
+          ull mem = tasks.MemoryUsage(*pendingIt);
+          if(mem <= freeMemory)
+          {
+            freeMemory -= mem;
+            queueTask(*pendingIt);
+            pendingIt = pending.erase(pendingIt);
+          }
+          else if(preferFit)
+            ++pendingIt;
+          else
+            break;
+        }
+      }
+      /** returns if the ready structure is the heap */
+      bool usesHeap() const { return type == shortestprocess || type == shortestremaining; }
+      /** returns the number of tasks in the ready structure */
+      size_t numReady() const
+      {
+        if(usesHeap())
+          return shortest.Size();
+        if(type == multilevel)
+        {
+          size_t count = 0;
+          for(auto& level : levels)
+            count += level.size();
+          return count;
+        }
+        return waiting.size();
+      }
+      /**
+       * puts a task into the ready structure of this thread's schedule type
+       */
+      void queueTask(TaskTable::Handle h)
+      {
+        if(type == shortestprocess)
+          shortest.Push(h, tasks.ProcessTime(h));
+        else if(type == shortestremaining)
+          shortest.Push(h, tasks.TimeRemaining(h));
+        else if(type == multilevel)
+          levels[tasks.Level(h)].push_back(h);
+        else
+          waiting.push_back(h);
+      }
+      /**
+       * removes a task from the ready structure
+       */
+      void removeReady(TaskTable::Handle h)
+      {
+        if(usesHeap())
+          shortest.Remove(h);
+        else
+        {
+          std::deque<TaskTable::Handle>& queue = type == multilevel ? levels[tasks.Level(h)] : waiting;
+          auto queueIt = std::find(queue.begin(), queue.end(), h);
+          if(queueIt != queue.end())
+            queue.erase(queueIt);
+        }
+      }
+      /**
+       * removes the ready task that would run last, ready structure
+       * must not be empty
+       */
+      TaskTable::Handle popReadyBack()
+      {
+        TaskTable::Handle h;
+        if(usesHeap())
+          h = shortest.PopBack();
+        else
+        {
+          std::deque<TaskTable::Handle>* queue = &waiting;
+          if(type == multilevel)
+          {
+            unsigned int level = MLFQ_LEVELS - 1;
+            while(levels[level].empty())
+              level--;
+            queue = &levels[level];
+          }
+          h = queue->back();
+          queue->pop_back();
+        }
+        return h;
+      }
+      /**
+       * removes the next task to run from the ready structure,
+       * starts a fresh quantum for it and stamps its first run
+       * @return  the task or NONE if nothing is waiting
+       */
+      TaskTable::Handle nextTask()
+      {
+        TaskTable::Handle h;
+        quantumUsed = 0;
+        if(usesHeap())
+        {
+          if(shortest.Empty())
+            return TaskTable::NONE;
+          h = shortest.Pop();
+        }
+        else
+        {
+          std::deque<TaskTable::Handle>* queue = &waiting;
+          if(type == multilevel)
+          {
+            unsigned int level = 0;
+            while(level < MLFQ_LEVELS - 1 && levels[level].empty())
+              level++;
+            queue = &levels[level];
+          }
+          if(queue->empty())
+            return TaskTable::NONE;
+          h = queue->front();
+          queue->pop_front();
+        }
+        if(tasks.FirstRunTime(h) == Task::NOT_RUN)
+          tasks.SetFirstRunTime(h, clock);
+        trace(TraceEvent::dispatch, h);
+        return h;
+      }
+      /**
+       * time the running task may run before it is preempted,
+       * 0 if it is never preempted by a quantum
+       */
+      ull currentQuantum() const
+      {
+        if(type == roundrobin)
+          return quantum;
+        if(type == multilevel)
+          return quantum << tasks.Level(running);
+        return 0;
+      }
+      /**
+       * puts the running task back if a waiting task should run before
+       * it: a shorter one for shortestremaining or one on a higher level
+       * for multilevel
+       */
+      void preemptIfNeeded()
+      {
+        if(running == TaskTable::NONE)
+          return;
+        bool preempt = false;
+        if(type == shortestremaining)
+          preempt = !shortest.Empty() && shortest.TopKey() < tasks.TimeRemaining(running);
+        else if(type == multilevel)
+        {
+          for(unsigned int level = 0; level < tasks.Level(running) && !preempt; level++)
+            preempt = !levels[level].empty();
+        }
+        if(preempt)
+        {
+          trace(TraceEvent::preempt, running);
+          tasks.Block(running);
+          queueTask(running);
+          running = nextTask();
+        }
+      }
+      /**
+       * moves every multilevel task back to the top level
+       */
+      void boost()
+      {
+        for(unsigned int level = 1; level < MLFQ_LEVELS; level++)
+        {
+          for(TaskTable::Handle h : levels[level])
+          {
+            tasks.SetLevel(h, 0);
+            levels[0].push_back(h);
+          }
+          levels[level].clear();
+        }
+        for(TaskTable::Handle h : pending)
+          tasks.SetLevel(h, 0);
+        if(running != TaskTable::NONE)
+          tasks.SetLevel(running, 0);
+        quantumUsed = 0;
+        nextBoost = clock + quantum * MLFQ_BOOST_QUANTA;
+      }
       void GetLock()
       {
-        // std::cout << "Getting Lock on thread: " << id << std::endl;
-        while(isLocked);
-        // std::cout << "Lock gotten on thread: " << id << std::endl;
-        isLocked = true;
+        lock.lock();
       }
       void Unlock()
       {
-        // std::cout << "Unlocked on thread: " << id << std::endl;
-        isLocked = false;
+        lock.unlock();
       }
   };
 
-  unsigned long long Thread::ID_COUNT = 0;
-  std::array<std::string, 3> Thread::TypeName = {"First In First Out", "Round Robbin 2", "Shortest Process First"};
+  std::atomic<unsigned long long> Thread::ID_COUNT(0);
+  const unsigned long long Thread::DEFAULT_QUANTUM;
+  const unsigned int Thread::MLFQ_LEVELS;
+  const size_t Thread::SUBMIT_CAPACITY;
+  const unsigned long long Thread::MLFQ_BOOST_QUANTA;
+  const unsigned long long Thread::DEFAULT_RETAIN_COUNT;
+  std::array<std::string, 5> Thread::TypeName = {"First In First Out", "Round Robin", "Shortest Process First",
+                                                 "Multilevel Feedback", "Shortest Remaining First"};
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,208 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#ifndef ull
+#define ull unsigned long long
+#endif
+
+namespace Shell
+{
+  /**
+   * One scheduler event of a Thread
+   */
+  struct TraceEvent
+  {
+    enum Type {thread, add, dispatch, preempt, block, finish, kill, donate, accept};
+    Type type;
+    /** id of the thread the event happened on */
+    ull threadId;
+    /** clock of that thread when it happened */
+    ull time;
+    /** id of the task, for a thread event its schedule type */
+    ull task;
+    /** process time of an added task, quantum of a thread */
+    ull processTime;
+    /** memory of an added task or a thread */
+    ull memory;
+    /** name of an added task */
+    std::string name;
+    /** if a thread prefers tasks that fit in its free memory */
+    bool preferFit;
+    /** retention settings of a thread, see Thread::SetRetention */
+    ull retainCount;
+    ull retainAge;
+
+    /** returns the name of an event type */
+    static std::string TypeString(Type t)
+    {
+      static const char* names[] = {"thread", "add", "dispatch", "preempt", "block", "finish", "kill", "donate", "accept"};
+      return names[t];
+    }
+  };
+
+  /**
+   * @brief Writes TraceEvents to a compact binary file
+   *
+   * The file starts with MAGIC and a version byte. Every event is its type
+   * byte followed by varint encoded fields, so small ids and times take a
+   * byte or two. Only thread and add events carry the extra fields, a
+   * thread event also its prefer-fit and retention settings. A task
+   * moved by work stealing is a donate on the thread it left followed
+   * by an accept on the one it went to.
+   */
+  class TraceWriter
+  {
+    public:
+      static const char MAGIC[4];
+      static const unsigned char VERSION = 2;
+
+    private:
+      std::ofstream out;
+      ull count;
+
+      void putVarint(ull value)
+      {
+        while(value >= 0x80)
+        {
+          out.put(static_cast<char>((value & 0x7f) | 0x80));
+          value >>= 7;
+        }
+        out.put(static_cast<char>(value));
+      }
+
+    public:
+      /**
+       * Creates the file and writes its header
+       * @param  path  file to write, replaced if it exists
+       */
+      explicit TraceWriter(const std::string& path) : out(path, std::ios::binary | std::ios::trunc), count(0)
+      {
+        out.write(MAGIC, sizeof(MAGIC));
+        out.put(static_cast<char>(VERSION));
+      }
+      /** returns if the file could be written */
+      bool Good() const { return out.good(); }
+      /** returns the number of events written */
+      ull Count() const { return count; }
+      void Write(const TraceEvent& event)
+      {
+        out.put(static_cast<char>(event.type));
+        putVarint(event.threadId);
+        putVarint(event.time);
+        putVarint(event.task);
+        if(event.type == TraceEvent::thread || event.type == TraceEvent::add)
+        {
+          putVarint(event.processTime);
+          putVarint(event.memory);
+        }
+        if(event.type == TraceEvent::thread)
+        {
+          putVarint(event.preferFit ? 1 : 0);
+          putVarint(event.retainCount);
+          putVarint(event.retainAge);
+        }
+        if(event.type == TraceEvent::add)
+        {
+          putVarint(event.name.size());
+          out.write(event.name.data(), event.name.size());
+        }
+        count++;
+      }
+      void Flush() { out.flush(); }
+  };
+  const char TraceWriter::MAGIC[4] = {'S', 'H', 'T', 'R'};
+
+  /**
+   * @brief Reads the events of a file made by TraceWriter
+   */
+  class TraceReader
+  {
+    private:
+      std::ifstream in;
+      std::string error;
+
+      bool getVarint(ull& value)
+      {
+        value = 0;
+        for(unsigned int shift = 0; shift < 64; shift += 7)
+        {
+          int byte = in.get();
+          if(byte == EOF)
+            return false;
+          value |= static_cast<ull>(byte & 0x7f) << shift;
+          if((byte & 0x80) == 0)
+            return true;
+        }
+        return false;
+      }
+
+    public:
+      /**
+       * Opens a trace and checks its header
+       * @param  path  file to read
+       */
+      explicit TraceReader(const std::string& path) : in(path, std::ios::binary)
+      {
+        char magic[sizeof(TraceWriter::MAGIC)];
+        if(!in)
+          error = "cannot open " + path;
+        else if(!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), TraceWriter::MAGIC))
+          error = path + " is not a trace";
+        else if(in.get() != TraceWriter::VERSION)
+          error = path + " has an unsupported trace version";
+      }
+      /** returns why the trace cannot be read, empty if it can */
+      const std::string& Error() const { return error; }
+      /**
+       * Reads the next event
+       * @return  false at the end of the file or if it is cut short,
+       *          Error tells which
+       */
+      bool Next(TraceEvent& event)
+      {
+        if(!error.empty())
+          return false;
+        int type = in.get();
+        if(type == EOF)
+          return false;
+        if(type > TraceEvent::accept)
+        {
+          error = "unknown trace event " + std::to_string(type);
+          return false;
+        }
+        event.type = static_cast<TraceEvent::Type>(type);
+        event.processTime = 0;
+        event.memory = 0;
+        event.name.clear();
+        event.preferFit = false;
+        event.retainCount = 0;
+        event.retainAge = 0;
+        bool ok = getVarint(event.threadId) && getVarint(event.time) && getVarint(event.task);
+        if(ok && (event.type == TraceEvent::thread || event.type == TraceEvent::add))
+          ok = getVarint(event.processTime) && getVarint(event.memory);
+        if(ok && event.type == TraceEvent::thread)
+        {
+          ull fit;
+          ok = getVarint(fit) && getVarint(event.retainCount) && getVarint(event.retainAge);
+          event.preferFit = fit != 0;
+        }
+        if(ok && event.type == TraceEvent::add)
+        {
+          ull length;
+          ok = getVarint(length) && length < (1ULL << 20);
+          if(ok)
+          {
+            event.name.resize(length);
+            ok = static_cast<bool>(in.read(&event.name[0], length));
+          }
+        }
+        if(!ok)
+          error = "trace is cut short";
+        return ok;
+      }
+  };
+}
+#endif
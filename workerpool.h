@@ -0,0 +1,115 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#ifndef ull
+#define ull unsigned long long
+#endif
+
+namespace Shell
+{
+  /**
+   * @brief Fixed set of host threads that run one job across all workers
+   *
+   * Run hands every worker its index and returns once all of them are done,
+   * so callers can shard work (e.g. simulated Threads) by index without
+   * spawning host threads on every tick. It is fork-join: one Run is one
+   * simulated step, there is no work that outlives it.
+   */
+  class WorkerPool
+  {
+    private:
+      std::vector<std::thread> workers;
+      std::mutex mtx;
+      /**
+       * signalled when a new job is published or the pool is stopping
+       */
+      std::condition_variable started;
+      /**
+       * signalled when the last worker finishes the current job
+       */
+      std::condition_variable finished;
+      /**
+       * job currently being run
+       */
+      std::function<void(size_t)> job;
+      /**
+       * bumped for every job so workers know there is new work
+       */
+      ull generation;
+      /**
+       * number of workers still running the current job
+       */
+      size_t remaining;
+      bool stopping;
+
+      void work(size_t index)
+      {
+        ull seen = 0;
+        while(true)
+        {
+          std::function<void(size_t)> current;
+          {
+            std::unique_lock<std::mutex> guard(mtx);
+            started.wait(guard, [&]{ return stopping || generation != seen; });
+            if(stopping)
+              return;
+            seen = generation;
+            current = job;
+          }
+          current(index);
+          std::lock_guard<std::mutex> guard(mtx);
+          if(--remaining == 0)
+            finished.notify_one();
+        }
+      }
+
+    public:
+      /**
+       * Starts the workers
+       * @param  count  number of host threads, at least one is started
+       */
+      explicit WorkerPool(size_t count) : generation(0), remaining(0), stopping(false)
+      {
+        if(count == 0)
+          count = 1;
+        for(size_t i = 0; i < count; i++)
+          workers.push_back(std::thread(&WorkerPool::work, this, i));
+      }
+      WorkerPool(const WorkerPool&) = delete;
+      WorkerPool& operator=(const WorkerPool&) = delete;
+      /**
+       * Stops and joins the workers
+       */
+      ~WorkerPool()
+      {
+        {
+          std::lock_guard<std::mutex> guard(mtx);
+          stopping = true;
+        }
+        started.notify_all();
+        for(auto& worker : workers)
+          worker.join();
+      }
+      /** returns the number of workers */
+      size_t Size() const { return workers.size(); }
+      /**
+       * Runs fn(index) on every worker and waits for all of them
+       * @param  fn  job to run, called once per worker index
+       */
+      void Run(const std::function<void(size_t)>& fn)
+      {
+        std::unique_lock<std::mutex> guard(mtx);
+        job = fn;
+        remaining = workers.size();
+        generation++;
+        started.notify_all();
+        finished.wait(guard, [&]{ return remaining == 0; });
+        job = nullptr;
+      }
+  };
+}
+#endif